@@ -14,44 +14,129 @@
 // If not, see <http://www.gnu.org/licenses/>.
 
 #include "inspect.hh"
+#include "kernels.hh"
+#include "thread_pool.hh"
 
 #include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
-#include <cctype>
+#include <charconv>
 #include <cmath>
-#include <future>
+#include <cstring>
+#include <functional>
 #include <istream>
 #include <iomanip>
-#include <locale>
+#include <limits>
+#include <memory>
 #include <sstream>
+#include <streambuf>
 #include <string>
+#include <type_traits>
+#include <variant>
 #include <vector>
 
+/// A read-only stream buffer over memory that it doesn't own. Lets each filter have its
+/// own stream position in data that's shared by all filters.
+class Span_Buffer : public std::streambuf
+{
+public:
+    Span_Buffer(std::span<std::byte const> data)
+    {
+        // The get area is never written through, so casting away const is safe.
+        auto begin = const_cast<char*>(reinterpret_cast<char const*>(data.data()));
+        setg(begin, begin, begin + data.size());
+    }
+
+protected:
+    pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+                     std::ios_base::openmode which) override
+    {
+        if (!(which & std::ios_base::in))
+            return pos_type(off_type(-1));
+        off_type base = dir == std::ios_base::beg ? 0
+            : dir == std::ios_base::cur ? gptr() - eback()
+            : egptr() - eback();
+        auto pos = base + off;
+        if (pos < 0 || pos > egptr() - eback())
+            return pos_type(off_type(-1));
+        setg(eback(), eback() + pos, egptr());
+        return pos_type(pos);
+    }
+    pos_type seekpos(pos_type pos, std::ios_base::openmode which) override
+    {
+        return seekoff(off_type(pos), std::ios_base::beg, which);
+    }
+};
+
+/// A match found by the stream engine.
+template <typename V>
+struct Match
+{
+    std::streamoff address = -1;
+    V value = {};
+};
+
+/// @return True if numbers of the given type must have their bytes reversed to be read on
+///    this machine.
+bool swaps(Type type)
+{
+    return is_big_endian(type) != (std::endian::native == std::endian::big);
+}
+
+/// @return The stride for offsets counted from 'offset' instead.
+Stride shift(Stride const& stride, std::size_t offset)
+{
+    return {stride.align, (stride.phase + stride.align - offset % stride.align) % stride.align};
+}
+
+/// @return The offsets the filter tests, counted from 'origin' in the file.
+Stride get_stride(Filter const& filter, std::streamoff origin)
+{
+    assert(std::has_single_bit(filter.align) && filter.phase < filter.align);
+    return shift({filter.align, filter.phase}, origin);
+}
+
 /// Find the next number of type T within the given range.
-/// @return An Entry for the number. If an appropriate number wasn't found, return a
-///    default Entry. Caller can check if the stream is good or if Entry::address is -1.
+/// @param swap If true, reverse the bytes of each number before testing it.
+/// @param stride The offsets in the stream to test.
+/// @return A Match for the number. If an appropriate number wasn't found, return a
+///    default Match. Caller can check if the stream is good or if Match::address is -1.
 template <typename T>
-Entry read_number(std::istream& is, T low, T high, T min)
+Match<T> read_number(std::istream& is, T low, T high, T min, bool swap,
+                     Stride const& stride)
 {
+    // Move to the next offset in the stride.
+    if (auto const skip = shift(stride, is.tellg()).phase; skip > 0)
+        is.seekg(skip, std::ios::cur);
     while(is)
     {
         auto start = is.tellg();
         T value;
-        is.read(reinterpret_cast<char*>(&value), sizeof value);
-        // Advance 1 byte
-        is.seekg(start + std::istream::pos_type(1));
-        if (low <= value && value <= high && (std::abs(value) >= min || value == 0))
+        if (!is.read(reinterpret_cast<char*>(&value), sizeof value))
+            break;
+        if (swap)
+            value = byte_swap(value);
+        // Advance to the next offset to test, or to the end if it's past the end.
+        if (!is.seekg(start + std::istream::pos_type(stride.align)))
         {
-            std::ostringstream is;
-            is << value;
-            return {start, is.str(), ""};
+            is.clear();
+            is.seekg(0, std::ios::end);
         }
+        if (low <= value && value <= high && (std::abs(value) >= min || value == 0))
+            return {start, value};
     }
     return {};
 };
 
+/// @return True if T is a character type that strings are read as.
 template <typename T>
-Entry read_string(std::istream& is, size_t low, size_t high)
+bool constexpr is_character = std::is_same_v<T, char8_t> || std::is_same_v<T, char16_t>;
+
+/// Find the next string of characters of type T that are printable in the character set
+/// Chars.
+template <typename T, typename Chars>
+Match<std::string> read_string(std::istream& is, size_t low, size_t high)
 {
     if (!is)
         return {};
@@ -79,19 +164,17 @@ Entry read_string(std::istream& is, size_t low, size_t high)
         if (c_low == '\0' || c_low == '\t' || c_low == '\n' || c_low == '\r')
         {
             if (len >= low)
-                return {start, out, ""};
+                return {start, out};
             restart();
         }
-        // Add a good character to the string. isprint() depends on the locale set in
-        // inspect(). If the locale is C it says whether the character is ASCII. If the
-        // locale is iso88591 it says whether it's in the Latin-1 set.
-        else if (std::isprint(c_low) && c_low == c && len < high)
+        // Add a good character to the string.
+        else if (Chars::printable[c_low] && c_low == c && len < high)
             out.push_back(c_low);
         else
         {
             // Bad character or too long.
             // Consume any remaining characters from an over-long string.
-            while (is && std::isprint(c_low) && c_low == c)
+            while (is && Chars::printable[c_low] && c_low == c)
             {
                 is.read(reinterpret_cast<char*>(&c), sizeof c);
                 c_low = static_cast<unsigned char>(c);
@@ -104,142 +187,1407 @@ Entry read_string(std::istream& is, size_t low, size_t high)
     return {};
 }
 
-template <typename T, typename R>
-Entry read_next(std::istream& is, R low, R high, R min)
+template <typename T, typename R, typename Chars>
+auto read_next(std::istream& is, R low, R high, R min, bool swap, Stride const& stride)
 {
-    return read_number<T>(is, low, high, min);
+    if constexpr (is_character<T>)
+        return read_string<T, Chars>(is, low, high);
+    else
+        return read_number<T>(is, low, high, min, swap, stride);
 }
 
-template <>
-Entry read_next<char8_t, size_t>(std::istream& is, size_t low, size_t high, size_t)
+/// The range of a filter converted to the type that's compared.
+template <typename R>
+struct Limits
+{
+    R low;
+    R high;
+    R min;
+};
+
+/// Parse the filter's range. Throw bad_range if it's empty.
+template <typename R>
+Limits<R> parse_limits(Range const& range)
 {
-    return read_string<char8_t>(is, low, high);
+    Limits<R> out;
+    std::istringstream is_low(range.low);
+    std::istringstream is_high(range.high);
+    std::istringstream is_min(range.min);
+    // setbase(0) gives prefix-dependent parsing: 0 for octal, 0x for hex.
+    is_low >> std::setbase(0) >> out.low;
+    is_high >> std::setbase(0) >> out.high;
+    is_min >> std::setbase(0) >> out.min;
+    // Reports hold string lengths in 32 bits. A range that's entirely past that is empty.
+    if constexpr (std::is_same_v<R, size_t>)
+        out.high = std::min<size_t>(out.high, std::numeric_limits<uint32_t>::max());
+    if (out.low > out.high)
+        throw(bad_range{range});
+    return out;
 }
 
-template <>
-Entry read_next<char16_t, size_t>(std::istream& is, size_t low, size_t high, size_t)
+/// @return True if the value is in the range and not excluded by 'min'.
+template <typename T>
+bool in_range(T value, Limits<T> const& limits)
 {
-    return read_string<char16_t>(is, low, high);
+    return limits.low <= value && value <= limits.high
+        && (std::abs(value) >= limits.min || value == 0);
 }
 
-/// Get everything in the stream that matches the given filter.
-template <typename T, typename R = T>
-Report find(std::istream&& is, Filter const& filter)
+/// The number of offsets that number filters test at a time.
+size_t constexpr block_size = 0x4000;
+
+/// Set a bit in 'mask' for each offset in the block that may hold a match. The integer
+/// kernels check the low and high limits only.
+/// @param swap If true, the numbers are in the other byte order.
+/// @param stride The offsets to test, counted from 'block'.
+template <typename T>
+void find_candidates(std::byte const* block, size_t count, Limits<T> const& limits,
+                     uint64_t* mask, bool swap, Stride const& stride)
 {
-    R low, high, min;
-    std::istringstream is_low(filter.range.low);
-    std::istringstream is_high(filter.range.high);
-    std::istringstream is_min(filter.range.min);
-    // setbase(0) gives prefix-dependent parsing: 0 for octal, 0x for hex.
-    is_low >> std::setbase(0) >> low;
-    is_high >> std::setbase(0) >> high;
-    is_min >> std::setbase(0) >> min;
-    if (low > high)
-        throw(bad_range{filter.range});
+    if constexpr (std::is_integral_v<T>)
+        match_range(block, count, limits.low, limits.high, mask, swap, stride);
+    else
+        match_range(block, count, limits.low, limits.high, limits.min, mask, swap, stride);
+}
+
+/// Find the candidates for two filters of the same type in opposite byte orders in one
+/// pass over the block. 'swapped' and 'swapped_mask' are for the one that isn't native.
+template <typename T>
+void find_candidates(std::byte const* block, size_t count, Limits<T> const& limits,
+                     Limits<T> const& swapped, uint64_t* mask, uint64_t* swapped_mask,
+                     Stride const& stride)
+{
+    if constexpr (std::is_integral_v<T>)
+        match_range_both(block, count, limits.low, limits.high, swapped.low, swapped.high,
+                         mask, swapped_mask, stride);
+    else
+        match_range_both(block, count, limits.low, limits.high, limits.min,
+                         swapped.low, swapped.high, swapped.min, mask, swapped_mask,
+                         stride);
+}
 
-    Report out;
+/// Add an entry for each candidate in the block that's a match. Numbers are kept in
+/// native byte order.
+/// @param offsets Room for an offset for each candidate.
+template <typename T>
+void add_matches(std::byte const* block, size_t address, size_t count,
+                 Limits<T> const& limits, uint64_t const* mask,
+                 Type type, bool swap, uint32_t* offsets, Report& out)
+{
+    // The floating point kernels test 'min' too. Every integer is at least 1 from zero
+    // unless it's zero.
+    auto const exact = std::is_floating_point_v<T> || limits.min <= 1;
+    if (exact && out.bucket() > 0)
+        return out.count_numbers(address, type, mask, count);
+
+    auto const n = mask_offsets(mask, count, offsets);
+    for (size_t k = 0; k < n; ++k)
+    {
+        auto const i = offsets[k];
+        T value;
+        std::memcpy(&value, block + i, sizeof value);
+        if (swap)
+            value = byte_swap(value);
+        if (exact || in_range(value, limits))
+            out.add_number(address + i, type, value);
+    }
+}
+
+/// Find all numbers of type T within the given range a block at a time.
+/// @param stride The offsets to test, counted from the start of the data.
+template <typename T>
+void scan_numbers(std::span<std::byte const> data, Limits<T> const& limits,
+                  Type type, Stride const& stride, Report& out)
+{
+    if (data.size() < sizeof(T))
+        return;
+    // The number of offsets with room for a T.
+    auto const count = data.size() - sizeof(T) + 1;
+    auto const swap = swaps(type);
+    std::array<uint64_t, block_size / 64> mask;
+    std::array<uint32_t, block_size> offsets;
+    for (size_t block = 0; block < count; block += block_size)
+    {
+        auto const size = std::min(block_size, count - block);
+        find_candidates(data.data() + block, size, limits, mask.data(), swap,
+                        shift(stride, block));
+        add_matches(data.data() + block, block, size, limits, mask.data(), type, swap,
+                    offsets.data(), out);
+    }
+}
+
+/// Find all strings of characters of type T with lengths in the given range. Gives the
+/// same strings as repeated calls to read_string() but reads from memory.
+template <typename T, typename Chars>
+void scan_strings(std::span<std::byte const> data, size_t low, size_t high,
+                  Type type, Report& out)
+{
+    auto const begin = data.data();
+    auto const end = begin + data.size();
+    auto start = begin;
+    auto p = begin;
+    std::string text;
+    text.reserve(high);
+
+    // Read the next character and advance.
+    auto read = [&p]() {
+        T c;
+        std::memcpy(&c, p, sizeof c);
+        p += sizeof c;
+        return c;
+    };
+    // Start looking for a new string 1 byte after the start of the last character read.
+    auto restart = [&p, &start, &text]() {
+        text.clear();
+        p -= sizeof(T) - 1;
+        start = p;
+    };
+
+    while (end - p >= static_cast<std::ptrdiff_t>(sizeof(T)))
+    {
+        auto c = read();
+        auto c_low = static_cast<unsigned char>(c);
+        if (c_low == '\0' || c_low == '\t' || c_low == '\n' || c_low == '\r')
+        {
+            if (text.length() >= low)
+            {
+                out.add_string(start - begin, type, text);
+                // Look for the next string after the terminator.
+                text.clear();
+                start = p;
+                continue;
+            }
+            restart();
+        }
+        else if (Chars::printable[c_low] && c_low == c && text.length() < high)
+            text.push_back(c_low);
+        else
+        {
+            // Skip the rest of an over-long string.
+            while (Chars::printable[c_low] && c_low == c)
+            {
+                // A string that runs to the end of the data isn't terminated.
+                if (end - p < static_cast<std::ptrdiff_t>(sizeof(T)))
+                    return;
+                c = read();
+                c_low = static_cast<unsigned char>(c);
+            }
+            restart();
+        }
+    }
+}
+
+template <typename T, typename R, typename Chars>
+void scan(std::span<std::byte const> data, Limits<R> const& limits,
+          Type type, Stride const& stride, Report& out)
+{
+    if constexpr (is_character<T>)
+        scan_strings<T, Chars>(data, limits.low, limits.high, type, out);
+    else
+        scan_numbers<T>(data, limits, type, stride, out);
+}
+
+/// Get everything in the data that matches the given filter. Strings are made of
+/// characters that are printable in the character set Chars.
+template <typename T, typename R = T, typename Chars = Ascii>
+Report find(std::span<std::byte const> data, Filter const& filter, Settings const& settings)
+{
+    auto const limits = parse_limits<R>(filter.range);
+    auto const type = to_type(filter.type);
+    auto const stride = get_stride(filter, settings.origin);
+    Report out(settings.bucket, settings.origin);
+    if (settings.engine == Engine::buffer)
+    {
+        scan<T, R, Chars>(data, limits, type, stride, out);
+        return out;
+    }
+
+    Span_Buffer buffer(data);
+    std::istream is(&buffer);
+    auto const swap = swaps(type);
     while (is)
     {
-        auto entry = read_next<T>(is, low, high, min);
-        if (is)
-            out.emplace(entry.address, entry.value, filter.type);
+        auto match = read_next<T, R, Chars>(is, limits.low, limits.high, limits.min, swap,
+                                            stride);
+        if (!is)
+            break;
+        if constexpr (is_character<T>)
+            out.add_string(match.address, type, match.value);
+        else
+            out.add_number(match.address, type, match.value);
     }
     return out;
 }
 
-/// Sort entries by stream position.
-bool constexpr operator<(Entry const& a, Entry const& b) noexcept
+/// @return The index of the first set bit at or after 'from' and before 'to' in the
+///    words given by word(), or 'to' if there isn't one.
+template <typename Word>
+size_t find_bit(Word word, size_t from, size_t to)
 {
-    auto a_addr = a.address >> 4;
-    auto b_addr = b.address >> 4;
-    // Sort by 16-byte "row". Sort by name of type within a row.  Note that this may put
-    // some entries out of address order, but allows a more orderly presentation with
-    // groping of repeated values.
-    return a_addr < b_addr || (a_addr == b_addr && a.type < b.type);
+    for (auto w = from / 64; 64 * w < to; ++w)
+    {
+        auto bits = word(w);
+        if (w == from / 64)
+            bits &= ~uint64_t(0) << (from % 64);
+        if (bits != 0)
+            return std::min(64 * w + std::countr_zero(bits), to);
+    }
+    return to;
 }
 
-Report inspect(std::istream& is_in, Spec const& spec)
+/// The part of the data that's in memory. The bytes start 'base' bytes into the data.
+/// All of the data is one window. A stream is read one window at a time.
+struct Window
+{
+    std::span<std::byte const> bytes;
+    size_t base = 0;
+    bool last = true; ///< False if more data follows.
+
+    /// @return The offset of the end of the window.
+    size_t end() const { return base + bytes.size(); }
+    /// @return The byte at the given offset in the data.
+    std::byte const* at(size_t offset) const { return bytes.data() + (offset - base); }
+    /// @return The end of the offsets that can be scanned. Matches at later offsets in a
+    ///    window that isn't the last may need bytes from the next window.
+    size_t limit() const { return last ? end() : (end() - 8) / 64 * 64; }
+};
+
+/// Where a string search is after reading a block.
+struct Search_State
+{
+    size_t start; ///< Offset of the next character that could start a string.
+    bool in_run; ///< True if the string at 'start' hasn't ended yet.
+    bool done; ///< True if the rest of the data can't hold a string.
+
+    bool operator==(Search_State const&) const = default;
+};
+
+/// The classes of the bytes in a block. They're shared by the string searches, so a block
+/// is classified once for all of them.
+struct Byte_Classes
+{
+    /// Indices of the sets of printable characters.
+    static size_t constexpr latin_1 = 0;
+    static size_t constexpr ascii = 1;
+    static size_t constexpr sets = 2;
+    static_assert(sets <= Charset::max_size);
+
+    /// Classify the bytes from 'block' up to 'until' unless they already are. An extra
+    /// byte is classified for the high byte of the last wide character.
+    /// @return The number of bytes classified.
+    size_t update(Window const& data, size_t block, size_t until)
+    {
+        static Charset const charset({Latin_1::printable, Ascii::printable});
+        auto const count = std::min(until + 1, data.end()) - block;
+        if (block != m_block || count != m_count)
+        {
+            std::array<uint64_t*, sets> bitmaps{printable[latin_1].data(),
+                                                printable[ascii].data()};
+            classify(data.at(block), count, charset, bitmaps.data(), terminator.data(),
+                     zero.data());
+            m_block = block;
+            m_count = count;
+        }
+        return count;
+    }
+
+    std::array<std::array<uint64_t, block_size / 64 + 1>, sets> printable;
+    std::array<uint64_t, block_size / 64 + 1> terminator;
+    std::array<uint64_t, block_size / 64 + 1> zero;
+
+private:
+    size_t m_block = 0; ///< The offset of the first byte classified.
+    size_t m_count = 0; ///< The number of bytes classified.
+};
+
+/// A search for strings that can be stopped at the end of one block of data and
+/// continued in the next. Finds the same strings as scan_strings().
+///
+/// Each block is classified with SIMD kernels. scan_strings() moves 1 byte ahead when it
+/// reads a character that can't start a string, so the search jumps straight from one
+/// character that can start a string to the character that ends it. Both are found by
+/// counting zeros in bitmaps.
+///
+/// Each byte is read a bounded number of times. A run of good characters that's too short
+/// to be a string is skipped without stopping in it. A search that has read past 'stop'
+/// doesn't read the rest of a string that's already too long to show. The next chunk's
+/// search reads it instead.
+template <typename T>
+class String_Search
+{
+public:
+    /// Search for strings that start at or after 'start' and before 'stop'. Strings that
+    /// start before 'stop' are read to the end, even if that's past 'stop'.
+    /// @param set The index of the printable characters in 'classes'.
+    String_Search(Limits<size_t> const& limits, Byte_Classes& classes, size_t set,
+                  size_t start, size_t stop)
+        : m_low(limits.low),
+          m_high(limits.high),
+          m_classes(classes),
+          m_set(set),
+          m_start(start),
+          m_stop(stop)
+    {}
+
+    Search_State state() const { return {m_start, m_in_run, m_done}; }
+    /// Continue from the given state.
+    void restart(Search_State const& state)
+    {
+        m_start = state.start;
+        m_in_run = state.in_run;
+        m_done = state.done;
+        m_read = state.start;
+    }
+    /// @return True if there's nothing left to read. Once the search has read past
+    ///    'stop', a string that's too long to show isn't read to its end. Any string after
+    ///    it would start after 'stop'.
+    bool finished() const
+    {
+        return m_done || (!m_in_run && m_start >= m_stop)
+            || (m_in_run && m_read >= m_stop && (m_read - m_start) / sizeof(T) > m_high);
+    }
+    /// @return The offset of the first byte needed to continue from 'state' after
+    ///    reading the bytes before 'until'.
+    size_t keep_from(Search_State const& state, size_t until) const
+    {
+        // A string that's already too long won't be shown.
+        return state.in_run && (until - state.start) / sizeof(T) <= m_high
+            ? state.start : until;
+    }
+
+    /// Read the characters that start from 'block' up to 'until'. 'block' must be even and
+    /// must be the previous call's 'until' unless this is the first call. The first block
+    /// may start before the search does.
+    void advance(Window const& data, size_t block, size_t until, Type type, Report& out)
+    {
+        auto constexpr size = sizeof(T);
+        if (finished())
+            return;
+
+        auto const count = m_classes.update(data, block, until);
+        auto const& printable = m_classes.printable[m_set];
+        auto const& terminator = m_classes.terminator;
+        auto const& zero = m_classes.zero;
+        auto const words = (count + 63) / 64;
+        for (size_t w = 0; w < words; ++w)
+        {
+            // A wide character is good if its low byte is printable and its high byte
+            // is zero. Check both byte parities at once.
+            m_good[w] = printable[w];
+            if constexpr (size == 2)
+                m_good[w] &= zero[w] >> 1 | (w + 1 < words ? zero[w + 1] : 0) << 63;
+        }
+
+        // Whole characters can be read at offsets before 'readable'. There's always
+        // another character if more data follows the window.
+        auto const readable = !data.last ? std::numeric_limits<size_t>::max()
+            : data.end() < size ? 0 : data.end() - size + 1;
+        auto const limit = std::min(until, readable) - std::min(block, readable);
+        auto const at_end = until >= readable;
+        m_read = block + limit;
+        if (m_low > 1)
+            mark_runs(words, limit);
+        auto const& starts = m_low > 1 ? m_runs : m_good;
+        auto const can_start = [this, &starts, &terminator](size_t w) {
+            return starts[w] | (m_low == 0 ? terminator[w] : 0);
+        };
+
+        while (true)
+        {
+            if (!m_in_run)
+            {
+                // Strings may not start at or after 'm_stop'. Unlike number candidates,
+                // the starts aren't listed with mask_offsets(). Where the next string can
+                // start depends on where the last one ended, and finding it only takes a
+                // countr_zero() on the current word.
+                auto const to = std::min(limit, m_stop - std::min(m_stop, block));
+                auto i = find_bit(can_start, m_start - block, to);
+                if (i == to)
+                {
+                    // Stopping doesn't mean there's nothing more to read.
+                    m_start = std::max(m_start, to < limit ? block + to : until);
+                    m_done = to == limit && at_end;
+                    return;
+                }
+                m_start = block + i;
+                if (!(m_good[i / 64] >> (i % 64) & 1))
+                {
+                    // A terminator right after a character that can't be in a string.
+                    out.add_string(m_start, type, {});
+                    m_start += size;
+                    continue;
+                }
+                m_in_run = true;
+            }
+
+            // Find the next character in this string's byte parity that's not good.
+            uint64_t const lane = size == 1 ? ~uint64_t(0)
+                : uint64_t(0x5555555555555555) << (m_start % 2);
+            auto const from = m_start >= block ? m_start - block
+                : size == 1 ? 0 : m_start % 2;
+            auto const i = find_bit([this, lane](size_t w) { return ~m_good[w] & lane; },
+                                    from, limit);
+            if (i == limit)
+            {
+                // The string continues in the next block.
+                m_done = at_end;
+                return;
+            }
+            auto const end = block + i;
+            auto const length = (end - m_start) / size;
+            if (terminator[i / 64] >> (i % 64) & 1 && m_low <= length && length <= m_high)
+            {
+                m_text.resize(length);
+                for (size_t j = 0; j < length; ++j)
+                    m_text[j] = std::to_integer<char>(*data.at(m_start + size*j));
+                out.add_string(m_start, type, m_text);
+                m_start = end + size;
+            }
+            else
+                m_start = end + 1;
+            m_in_run = false;
+        }
+    }
+
+private:
+    /// Set m_runs to the good characters that are followed by at least m_low - 1 more in
+    /// the same byte parity. A shorter run ends in a character that's not good, and there
+    /// are no good characters in the other parity within it, so a search that finds its
+    /// first character would fail and restart after it. Characters at or after 'limit'
+    /// count as good.
+    void mark_runs(size_t words, size_t limit)
+    {
+        for (size_t w = 0; w < words; ++w)
+            m_runs[w] = m_good[w] | (w < limit / 64 ? 0
+                                     : w > limit / 64 ? ~uint64_t(0)
+                                     : ~uint64_t(0) << (limit % 64));
+        // AND the bitmap with itself shifted down by n characters to get the starts of
+        // 2n good ones, until there are enough. Runs longer than the block all reach the
+        // good characters past its end.
+        auto const length = std::min(m_low, 64*words/sizeof(T) + 1);
+        for (size_t n = 1; n < length; n *= 2)
+        {
+            auto const shift = std::min(n, length - n) * sizeof(T);
+            auto const word = [&](size_t w) { return w < words ? m_runs[w] : ~uint64_t(0); };
+            for (size_t w = 0; w < words; ++w)
+            {
+                auto shifted = word(w + shift / 64) >> (shift % 64);
+                if (shift % 64 != 0)
+                    shifted |= word(w + shift / 64 + 1) << (64 - shift % 64);
+                m_runs[w] &= shifted;
+            }
+        }
+    }
+
+    size_t const m_low;
+    size_t const m_high;
+    Byte_Classes& m_classes;
+    size_t const m_set; ///< The index of the printable characters in 'm_classes'.
+    size_t m_start = 0; ///< Offset of the first character of the current string.
+    size_t const m_stop; ///< Strings must start before this offset.
+    bool m_in_run = false; ///< True if the end of the current string hasn't been read.
+    bool m_done = false; ///< True if the rest of the data can't hold a string.
+    size_t m_read = 0; ///< The end of the characters read so far.
+    /// Offsets of characters that could be in a string.
+    std::array<uint64_t, block_size / 64 + 1> m_good;
+    /// Offsets of characters that start long enough runs of good ones. See mark_runs().
+    std::array<uint64_t, block_size / 64 + 1> m_runs;
+    /// The text of the last string found.
+    std::string m_text;
+};
+
+/// A number filter prepared for the fused engine.
+struct Number_Test
+{
+    std::variant<Limits<double>, Limits<float>,
+                 Limits<int64_t>, Limits<int32_t>, Limits<int16_t>> limits;
+    Type type;
+    Report& out;
+    /// True if the numbers are in the other byte order.
+    bool swap = false;
+    /// The offsets to test, counted from the start of the data.
+    Stride stride = {};
+    /// A filter for numbers of the same size in the other byte order. The two are run
+    /// together by the one that isn't swapped, so each block is loaded once for both.
+    Number_Test* other = nullptr;
+};
+
+/// A string filter prepared for the fused engine.
+struct String_Test
+{
+    std::variant<String_Search<char8_t>, String_Search<char16_t>> search;
+    Type type;
+    Report& out;
+    /// The state of the search at the end of each block it read in its chunk.
+    std::vector<Search_State> states = {};
+    /// The state of the search when it reached the end of its chunk, or the end of the
+    /// window if a string runs past that.
+    Search_State exit = {};
+};
+
+/// A pass through one chunk of the data for all filters. All filters read a block while
+/// it's still in the cache before moving on to the next one.
+///
+/// Chunks are scanned in parallel. A number may start anywhere in the chunk and end in
+/// the next one. Where the strings start depends on where the previous string ended, so
+/// string searches start at the beginning of the chunk as if a string could start there.
+/// After all chunks are scanned, stitch() corrects the strings near the start of each
+/// chunk, rescanning only until the true search and the guess agree.
+class Chunk_Scan
+{
+public:
+    /// Prepare to scan from 'begin' to 'end'. 'begin' must be even.
+    /// @param settings If Settings::bucket isn't 0, numbers are counted. Strings are kept
+    ///    because stitch() may need to remove some.
+    Chunk_Scan(Window const& data, Spec const& spec, Settings const& settings, size_t begin,
+               size_t end);
+    Chunk_Scan(Chunk_Scan const&) = delete;
+    Chunk_Scan& operator=(Chunk_Scan const&) = delete;
+
+    /// Find the matches in the chunk.
+    void run();
+    /// Correct the strings found by run() given where the previous chunk's searches
+    /// ended. Chunks must be stitched in order.
+    /// @param entries The states of the string searches at the start of the chunk.
+    void stitch(std::vector<Search_State> const& entries);
+    /// @return The states of the string searches at the end of the chunk.
+    std::vector<Search_State> exits() const;
+    /// @return The offset of the first byte needed to continue the string searches in
+    ///    the next window.
+    size_t keep_from() const;
+    /// @return The matches for each filter.
+    std::vector<Report> const& reports() const { return m_reports; }
+
+private:
+    Window m_data;
+    size_t m_begin;
+    size_t m_end;
+    std::vector<Report> m_reports;
+    std::vector<Number_Test> m_numbers;
+    /// The classes of the block that the string searches last read.
+    Byte_Classes m_classes;
+    std::vector<String_Test> m_strings;
+};
+
+Chunk_Scan::Chunk_Scan(Window const& data, Spec const& spec, Settings const& settings,
+                       size_t begin, size_t end)
+    : m_data(data),
+      m_begin(begin),
+      m_end(end),
+      m_reports(spec.size(), Report(0, settings.origin))
 {
-    std::string content((std::istreambuf_iterator<char>(is_in)), std::istreambuf_iterator<char>());
-    std::vector<std::future<Report>> outs;
-    for (auto const& filter : spec)
+    auto search = [&]<typename T>(T, Range const& range, size_t set) {
+        return String_Search<T>(parse_limits<size_t>(range), m_classes, set, begin, end);
+    };
+    for (size_t i = 0; i < spec.size(); ++i)
     {
-        if (filter.type == "f64")
-            outs.push_back(std::async(find<double>, std::istringstream(content), filter));
-        else if (filter.type == "f32")
-            outs.push_back(std::async(find<float>, std::istringstream(content), filter));
-        else if (filter.type == "i64")
-            outs.push_back(std::async(find<int64_t>, std::istringstream(content), filter));
-        else if (filter.type == "i32")
-            outs.push_back(std::async(find<int32_t>, std::istringstream(content), filter));
-        else if (filter.type == "i16")
-            outs.push_back(std::async(find<int16_t>, std::istringstream(content), filter));
-        else if (filter.type == "s8")
+        auto const& range = spec[i].range;
+        auto const type = to_type(spec[i].type);
+        auto const stride = get_stride(spec[i], settings.origin);
+        auto& out = m_reports[i];
+        if (!is_string(type))
+            out = Report(settings.bucket, settings.origin);
+        switch (type)
         {
-            std::setlocale(LC_ALL, "en_US.iso88591"); // isprint() -> Latin-1
-            outs.push_back(std::async(find<char8_t, size_t>, std::istringstream(content), filter));
+        case Type::f64:
+        case Type::f64be:
+            m_numbers.push_back({parse_limits<double>(range), type, out, swaps(type),
+                                 stride});
+            break;
+        case Type::f32:
+        case Type::f32be:
+            m_numbers.push_back({parse_limits<float>(range), type, out, swaps(type),
+                                 stride});
+            break;
+        case Type::i64:
+        case Type::i64be:
+            m_numbers.push_back({parse_limits<int64_t>(range), type, out, swaps(type),
+                                 stride});
+            break;
+        case Type::i32:
+        case Type::i32be:
+            m_numbers.push_back({parse_limits<int32_t>(range), type, out, swaps(type),
+                                 stride});
+            break;
+        case Type::i16:
+        case Type::i16be:
+            m_numbers.push_back({parse_limits<int16_t>(range), type, out, swaps(type),
+                                 stride});
+            break;
+        case Type::s8:
+            m_strings.push_back({search(char8_t(), range, Byte_Classes::latin_1), type, out});
+            break;
+        case Type::s16:
+            m_strings.push_back({search(char16_t(), range, Byte_Classes::latin_1), type, out});
+            break;
+        case Type::a8:
+            m_strings.push_back({search(char8_t(), range, Byte_Classes::ascii), type, out});
+            break;
+        case Type::a16:
+            m_strings.push_back({search(char16_t(), range, Byte_Classes::ascii), type, out});
+            break;
         }
-        else if (filter.type == "s16")
+    }
+
+    // Pair up filters for numbers of the same size in opposite byte orders.
+    for (auto& test : m_numbers)
+        for (auto& other : m_numbers)
+            if (!test.other && !other.other && test.swap != other.swap
+                && test.limits.index() == other.limits.index()
+                && test.stride.align == other.stride.align
+                && test.stride.phase == other.stride.phase)
+            {
+                test.other = &other;
+                other.other = &test;
+            }
+}
+
+void Chunk_Scan::run()
+{
+    std::array<uint64_t, block_size / 64> mask;
+    std::array<uint64_t, block_size / 64> swapped_mask;
+    std::array<uint32_t, block_size> offsets;
+    for (auto block = m_begin; block < m_end; block += block_size)
+    {
+        auto const until = std::min(block + block_size, m_end);
+        for (auto& test : m_numbers)
         {
-            std::setlocale(LC_ALL, "en_US.iso88591"); // isprint() -> Latin-1
-            outs.push_back(std::async(find<char16_t, size_t>, std::istringstream(content), filter));
+            // A pair is run by its native half.
+            if (test.other && test.swap)
+                continue;
+            std::visit([&](auto const& limits) {
+                auto constexpr size = sizeof(limits.low);
+                // Test the offsets in the block with room for a number. The number may
+                // extend into the next chunk.
+                if (m_data.end() < size || block > m_data.end() - size)
+                    return;
+                auto const count = std::min(until, m_data.end() - size + 1) - block;
+                auto const stride = shift(test.stride, block);
+                if (!test.other)
+                {
+                    find_candidates(m_data.at(block), count, limits, mask.data(),
+                                    test.swap, stride);
+                    add_matches(m_data.at(block), block, count, limits, mask.data(),
+                                test.type, test.swap, offsets.data(), test.out);
+                    return;
+                }
+                auto const& other = *test.other;
+                auto const& swapped = std::get<std::decay_t<decltype(limits)>>(other.limits);
+                find_candidates(m_data.at(block), count, limits, swapped, mask.data(),
+                                swapped_mask.data(), stride);
+                add_matches(m_data.at(block), block, count, limits, mask.data(),
+                            test.type, false, offsets.data(), test.out);
+                add_matches(m_data.at(block), block, count, swapped, swapped_mask.data(),
+                            other.type, true, offsets.data(), other.out);
+            }, test.limits);
         }
-        else if (filter.type == "a8")
+        for (auto& test : m_strings)
+            std::visit([&](auto& search) {
+                if (search.finished())
+                    return;
+                search.advance(m_data, block, until, test.type, test.out);
+                test.states.push_back(search.state());
+            }, test.search);
+    }
+
+    // Read to the end of strings that started in this chunk.
+    auto const limit = m_data.limit();
+    for (auto& test : m_strings)
+        std::visit([&](auto& search) {
+            for (auto block = m_end; !search.finished() && block < limit; block += block_size)
+                search.advance(m_data, block, std::min(block + block_size, limit),
+                               test.type, test.out);
+            test.exit = search.state();
+        }, test.search);
+}
+
+void Chunk_Scan::stitch(std::vector<Search_State> const& entries)
+{
+    auto const limit = m_data.limit();
+    for (size_t i = 0; i < m_strings.size(); ++i)
+    {
+        auto& test = m_strings[i];
+        auto const entry = entries[i];
+        if (entry == Search_State{m_begin, false, false})
+            continue; // The guess was right.
+
+        std::visit([&](auto const& guess) {
+            auto search = guess;
+            search.restart(entry);
+            Report fixed(0, test.out.origin());
+            // A string from the previous window may still be running.
+            auto block = m_begin + (std::clamp(entry.start, m_begin, m_end) - m_begin)
+                / block_size * block_size;
+            for (auto j = (block - m_begin) / block_size; !search.finished() && block < limit;
+                 ++j, block += block_size)
+            {
+                search.advance(m_data, block, std::min(block + block_size, limit),
+                               test.type, fixed);
+                if (j < test.states.size() && search.state() == test.states[j])
+                {
+                    // The searches are in the same state, so they find the same strings
+                    // from here on.
+                    auto const cut = static_cast<std::streamoff>(search.state().start)
+                        + test.out.origin();
+                    for (auto const& match : test.out)
+                        if (match.address >= cut)
+                            fixed.add(test.out, match);
+                    test.out = std::move(fixed);
+                    return;
+                }
+            }
+            test.out = std::move(fixed);
+            test.exit = search.state();
+        }, test.search);
+    }
+}
+
+std::vector<Search_State> Chunk_Scan::exits() const
+{
+    std::vector<Search_State> out;
+    for (auto const& test : m_strings)
+        out.push_back(test.exit);
+    return out;
+}
+
+size_t Chunk_Scan::keep_from() const
+{
+    auto const limit = m_data.limit();
+    auto out = limit;
+    for (auto const& test : m_strings)
+        std::visit([&](auto const& search) {
+            out = std::min(out, search.keep_from(test.exit, limit));
+        }, test.search);
+    return out;
+}
+
+/// Where the fused engine stopped reading a window.
+struct Seam
+{
+    /// The states of the string searches in the order of the string filters. Empty if
+    /// nothing has been read.
+    std::vector<Search_State> strings;
+    /// Offset of the first byte the next window needs.
+    size_t keep = 0;
+};
+
+/// Get everything that matches any filter in one pass through the window from 'begin'.
+/// The window is split into chunks that are scanned in parallel.
+/// @param seam Where the previous window stopped. Set to where this one stops.
+std::vector<Report> find_all(Window const& data, size_t begin, Spec const& spec,
+                             Settings const& settings, Thread_Pool& pool, Seam& seam)
+{
+    // A few chunks per thread keep the threads busy when some chunks have more matches
+    // than others. Chunks start on block boundaries. There's at least one chunk, even for
+    // empty data, so the spec is always checked.
+    auto const limit = data.limit();
+    auto const count = pool.threads() > 1 ? 4*pool.threads() : 1;
+    auto const per_chunk = (limit - begin + count - 1) / count;
+    auto const chunk_size = std::max((per_chunk + block_size - 1) / block_size, size_t(1))
+        * block_size;
+    std::vector<std::unique_ptr<Chunk_Scan>> chunks;
+    std::vector<std::function<void()>> tasks;
+    do
+    {
+        auto const end = std::min(begin + chunk_size, limit);
+        chunks.push_back(std::make_unique<Chunk_Scan>(data, spec, settings, begin, end));
+        tasks.push_back([chunk = chunks.back().get()] { chunk->run(); });
+        begin = end;
+    } while (begin < limit);
+
+    pool.run(std::move(tasks));
+    if (!seam.strings.empty())
+        chunks.front()->stitch(seam.strings);
+    for (size_t k = 1; k < chunks.size(); ++k)
+        chunks[k]->stitch(chunks[k - 1]->exits());
+    seam = {chunks.back()->exits(), chunks.back()->keep_from()};
+
+    // Strings are counted here if the numbers were.
+    std::vector<Report> reports(spec.size(), Report(settings.bucket));
+    for (size_t i = 0; i < spec.size(); ++i)
+        for (auto const& chunk : chunks)
+            reports[i].merge(chunk->reports()[i]);
+    return reports;
+}
+
+/// Get everything that matches the filter with the stream or buffer engine.
+Report find_any(std::span<std::byte const> data, Filter const& filter,
+                Settings const& settings)
+{
+    if (filter.type == "f64" || filter.type == "f64be")
+        return find<double>(data, filter, settings);
+    else if (filter.type == "f32" || filter.type == "f32be")
+        return find<float>(data, filter, settings);
+    else if (filter.type == "i64" || filter.type == "i64be")
+        return find<int64_t>(data, filter, settings);
+    else if (filter.type == "i32" || filter.type == "i32be")
+        return find<int32_t>(data, filter, settings);
+    else if (filter.type == "i16" || filter.type == "i16be")
+        return find<int16_t>(data, filter, settings);
+    else if (filter.type == "s8")
+        return find<char8_t, size_t, Latin_1>(data, filter, settings);
+    else if (filter.type == "s16")
+        return find<char16_t, size_t, Latin_1>(data, filter, settings);
+    else if (filter.type == "a8")
+        return find<char8_t, size_t, Ascii>(data, filter, settings);
+    else if (filter.type == "a16")
+        return find<char16_t, size_t, Ascii>(data, filter, settings);
+    throw(unknown_type(filter.type));
+}
+
+/// @return The number of threads to scan with.
+unsigned jobs(Settings const& settings)
+{
+    return settings.jobs > 0 ? settings.jobs : available_cpus();
+}
+
+/// Passes matches on in order once no later window can add to their rows.
+class Ordered_Output
+{
+public:
+    Ordered_Output(size_t filters, std::streamoff bucket, Report_Sink const& sink)
+        : m_pending(filters, Report(bucket)),
+          m_sink(sink)
+    {}
+
+    /// Add the matches for each filter from a window. Pass on the rows before the one
+    /// with 'watermark'. Later windows only find matches from 'watermark' on.
+    /// @return False if the sink asked to stop.
+    bool add(std::vector<Report> const& found, std::streamoff watermark)
+    {
+        // Keep the filters' reports separate until they're final so that entries that
+        // sort the same stay in filter order.
+        std::vector<Report> done;
+        for (size_t i = 0; i < m_pending.size(); ++i)
         {
-            std::setlocale(LC_ALL, "C"); // isprint() -> ASCII
-            outs.push_back(std::async(find<char8_t, size_t>, std::istringstream(content), filter));
+            m_pending[i].merge(found[i]);
+            done.push_back(m_pending[i].take_rows_before(watermark));
         }
-        else if (filter.type == "a16")
+        auto const report = Report::merge(done);
+        return report.empty() || m_sink(report);
+    }
+private:
+    std::vector<Report> m_pending;
+    Report_Sink const& m_sink;
+};
+
+/// Scan with the fused engine one window at a time until the data ends or the sink asks
+/// to stop.
+/// @param next_window Called with the offset of the first byte that's still needed and
+///    the number of bytes to add. Returns the next window.
+template <typename Next>
+void scan_windows(Next next_window, Spec const& spec, Settings const& settings,
+                  Report_Sink const& sink)
+{
+    Thread_Pool pool(jobs(settings));
+    Ordered_Output out(spec.size(), settings.bucket, sink);
+    // Start with a small window so that a sink that stops at the first match doesn't
+    // wait for a large one. Double it up to the maximum.
+    auto const max_size = std::max(settings.window, block_size);
+    auto size = block_size;
+    size_t begin = 0;
+    Seam seam;
+    while (true)
+    {
+        auto const window = next_window(seam.keep, size);
+        auto const found = find_all(window, begin, spec, settings, pool, seam);
+        // Strings that haven't ended start at or after the seam.
+        auto const watermark = window.last ? std::numeric_limits<std::streamoff>::max()
+            : settings.origin + static_cast<std::streamoff>(seam.keep);
+        if (!out.add(found, watermark) || window.last)
+            return;
+        begin = window.limit();
+        size = std::min(2*size, max_size);
+    }
+}
+
+void inspect(std::istream& is, Spec const& spec, Settings const& settings,
+             Report_Sink const& sink)
+{
+    if (settings.engine != Engine::fused)
+    {
+        // The other engines read all of the data at once.
+        std::string content((std::istreambuf_iterator<char>(is)),
+                            std::istreambuf_iterator<char>());
+        return inspect(std::as_bytes(std::span(content)), spec, settings, sink);
+    }
+
+    std::vector<std::byte> buffer;
+    // Leave room for the bytes that are kept from one window to the next so the buffer
+    // doesn't grow unless a long string is kept.
+    buffer.reserve(std::max(settings.window, block_size) + block_size);
+    size_t base = 0;
+    auto const read_window = [&](size_t keep_from, size_t size) {
+        // Drop the bytes that aren't needed any more and read the next window after the
+        // rest.
+        auto const keep = keep_from - base;
+        std::copy(buffer.begin() + keep, buffer.end(), buffer.begin());
+        buffer.resize(buffer.size() - keep + size);
+        auto const kept = buffer.size() - size;
+        is.read(reinterpret_cast<char*>(buffer.data() + kept), size);
+        buffer.resize(kept + is.gcount());
+        base = keep_from;
+        return Window{buffer, base, !is};
+    };
+    scan_windows(read_window, spec, settings, sink);
+}
+
+void inspect(std::span<std::byte const> data, Spec const& spec, Settings const& settings,
+             Report_Sink const& sink)
+{
+    if (settings.engine == Engine::fused)
+    {
+        size_t end = 0;
+        // All of the data is there, so windows don't need to drop anything.
+        auto const next_window = [&](size_t, size_t size) {
+            end = std::min(end + size, data.size());
+            return Window{data.first(end), 0, end == data.size()};
+        };
+        return scan_windows(next_window, spec, settings, sink);
+    }
+
+    // One task per filter.
+    Thread_Pool pool(jobs(settings));
+    std::vector<Report> reports(spec.size());
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < spec.size(); ++i)
+        tasks.push_back([&, i] { reports[i] = find_any(data, spec[i], settings); });
+    pool.run(std::move(tasks));
+    auto const report = Report::merge(reports);
+    if (!report.empty())
+        sink(report);
+}
+
+Report inspect(std::istream& is, Spec const& spec, Settings const& settings)
+{
+    Report out(settings.bucket);
+    inspect(is, spec, settings, [&](Report const& part) {
+        out.merge(part);
+        return true;
+    });
+    return out;
+}
+
+Report inspect(std::span<std::byte const> data, Spec const& spec, Settings const& settings)
+{
+    Report out(settings.bucket);
+    inspect(data, spec, settings, [&](Report const& part) {
+        out.merge(part);
+        return true;
+    });
+    return out;
+}
+
+/// The names of the types, in the order of Type.
+std::array<char const*, 14> const type_names{
+    "a16", "a8", "f32", "f32be", "f64", "f64be", "i16", "i16be", "i32", "i32be", "i64",
+    "i64be", "s16", "s8"};
+
+/// Room for any number formatted by format_number().
+using Number_Buffer = std::array<char, 32>;
+
+/// Format the number in an entry's bits as operator<<() does.
+/// @return The text, which may be in 'buffer'.
+template <typename T>
+std::string_view format_number(std::uint64_t bits, Number_Buffer& buffer)
+{
+    T value;
+    std::memcpy(&value, &bits, sizeof value);
+    // Zero-filled and all-ones data give many of these.
+    if (value == 0 && !std::signbit(value))
+        return "0";
+    if constexpr (std::is_integral_v<T>)
+        if (value == -1)
+            return "-1";
+
+    auto const first = buffer.data();
+    std::to_chars_result result;
+    if constexpr (std::is_floating_point_v<T>)
+        // The default stream precision.
+        result = std::to_chars(first, first + buffer.size(), value,
+                               std::chars_format::general, 6);
+    else
+        result = std::to_chars(first, first + buffer.size(), value);
+    return {first, static_cast<size_t>(result.ptr - first)};
+}
+
+/// @return The value of an entry formatted for display, which may be in 'buffer'.
+std::string_view format_value(Report const& report, Entry const& entry,
+                              Number_Buffer& buffer)
+{
+    // Numbers are kept in native byte order.
+    switch (entry.type)
+    {
+    case Type::f64:
+    case Type::f64be:
+        return format_number<double>(entry.bits, buffer);
+    case Type::f32:
+    case Type::f32be:
+        return format_number<float>(entry.bits, buffer);
+    case Type::i64:
+    case Type::i64be:
+        return format_number<int64_t>(entry.bits, buffer);
+    case Type::i32:
+    case Type::i32be:
+        return format_number<int32_t>(entry.bits, buffer);
+    case Type::i16:
+    case Type::i16be:
+        return format_number<int16_t>(entry.bits, buffer);
+    default:
+        return report.text(entry);
+    }
+}
+
+std::string to_string(Type type)
+{
+    return type_names[static_cast<size_t>(type)];
+}
+
+Type to_type(std::string const& name)
+{
+    auto it = std::find(type_names.begin(), type_names.end(), name);
+    if (it == type_names.end())
+        throw(unknown_type(name));
+    return static_cast<Type>(it - type_names.begin());
+}
+
+bool is_string(Type type)
+{
+    return type == Type::a16 || type == Type::a8 || type == Type::s16 || type == Type::s8;
+}
+
+bool is_big_endian(Type type)
+{
+    return type == Type::f32be || type == Type::f64be || type == Type::i16be
+        || type == Type::i32be || type == Type::i64be;
+}
+
+Type other_byte_order(Type type)
+{
+    assert(!is_string(type));
+    // Each big-endian type follows its little-endian one.
+    auto const index = static_cast<std::uint8_t>(type);
+    return static_cast<Type>(is_big_endian(type) ? index - 1 : index + 1);
+}
+
+void Report::add_count(std::streamoff address, Type type, std::uint64_t count)
+{
+    address -= address % m_bucket;
+    if (!m_entries.empty() && m_entries.back().address == address
+        && m_entries.back().type == type)
+    {
+        m_entries.back().bits += count;
+        return;
+    }
+    Entry entry{address, count, 0, type};
+    assert(m_entries.empty() || !(entry < m_entries.back()));
+    m_entries.push_back(entry);
+}
+
+void Report::count_numbers(std::streamoff address, Type type, std::uint64_t const* mask,
+                           std::size_t count)
+{
+    assert(m_bucket > 0);
+    address += m_origin;
+    for (size_t word = 0; word < (count + 63) / 64; ++word)
+    {
+        auto const first = address + 64*word;
+        // Count the bits in each bucket that the word covers at once.
+        for (auto bits = mask[word]; bits != 0;)
         {
-            std::setlocale(LC_ALL, "C"); // isprint() -> ASCII
-            outs.push_back(std::async(find<char16_t, size_t>, std::istringstream(content), filter));
+            auto const at = first + std::countr_zero(bits);
+            auto const end = at - at % m_bucket + m_bucket - first;
+            auto const in_bucket = end < 64 ? bits & ((uint64_t(1) << end) - 1) : bits;
+            add_count(at, type, std::popcount(in_bucket));
+            bits &= ~in_bucket;
         }
+    }
+}
+
+void Report::combine_counts()
+{
+    auto const same = [](Entry const& a, Entry const& b) {
+        return a.address == b.address && a.type == b.type;
+    };
+    auto out = m_entries.begin();
+    for (auto it = m_entries.begin(); it != m_entries.end(); ++it)
+    {
+        if (out != m_entries.begin() && same(*std::prev(out), *it))
+            std::prev(out)->bits += it->bits;
+        else
+            *out++ = *it;
+    }
+    m_entries.erase(out, m_entries.end());
+}
+
+void Report::add_string(std::streamoff address, Type type, std::string_view text)
+{
+    address += m_origin;
+    if (m_bucket > 0)
+        return add_count(address, type, 1);
+    Entry entry{address, m_text.size(), static_cast<std::uint32_t>(text.size()), type};
+    assert(m_entries.empty() || !(entry < m_entries.back()));
+    m_entries.push_back(entry);
+    m_text.append(text);
+}
+
+void Report::add(Report const& other, Entry const& entry)
+{
+    if (m_bucket > 0)
+        add_count(entry.address, entry.type, other.m_bucket > 0 ? entry.bits : 1);
+    else if (is_string(entry.type))
+        // The entry's address already has the origin added.
+        add_string(entry.address - m_origin, entry.type, other.text(entry));
+    else
+    {
+        assert(m_entries.empty() || !(entry < m_entries.back()));
+        m_entries.push_back(entry);
+    }
+}
+
+void Report::merge(Report const& other)
+{
+    assert(m_bucket > 0 || other.m_bucket == 0);
+    if (m_bucket > 0 && other.m_bucket == 0)
+    {
+        // Count the other report's matches first.
+        Report counted(m_bucket);
+        for (auto const& entry : other)
+            counted.add(other, entry);
+        return merge(counted);
+    }
+    auto const middle = m_entries.size();
+    // String offsets move past the text that's already here.
+    auto const offset = m_text.size();
+    m_entries.reserve(m_entries.size() + other.size());
+    for (auto entry : other)
+    {
+        if (is_string(entry.type) && m_bucket == 0)
+            entry.bits += offset;
+        m_entries.push_back(entry);
+    }
+    m_text.append(other.m_text);
+    // Reports of consecutive chunks just need to be appended.
+    if (middle > 0 && middle < m_entries.size()
+        && m_entries[middle] < m_entries[middle - 1])
+    {
+        std::inplace_merge(m_entries.begin(), m_entries.begin() + middle, m_entries.end());
+    }
+    if (m_bucket > 0)
+        combine_counts();
+}
+
+Report Report::merge(std::vector<Report> const& reports)
+{
+    Report out(reports.empty() ? 0 : reports.front().m_bucket);
+    size_t entries = 0;
+    size_t text = 0;
+    for (auto const& report : reports)
+    {
+        entries += report.size();
+        text += report.m_text.size();
+    }
+    out.m_entries.reserve(entries);
+    out.m_text.reserve(text);
+
+    // The next entry of each report and where its strings' text will be in 'out'.
+    struct Head
+    {
+        const_iterator it;
+        const_iterator end;
+        size_t report;
+        size_t offset;
+    };
+    std::vector<Head> heads;
+    for (size_t i = 0; i < reports.size(); ++i)
+    {
+        if (!reports[i].empty())
+            heads.push_back({reports[i].begin(), reports[i].end(), i, out.m_text.size()});
+        out.m_text.append(reports[i].m_text);
+    }
+    // A min-heap on the next entry. Ties go to the earlier report.
+    auto const later = [](Head const& a, Head const& b) {
+        return *b.it < *a.it || (!(*a.it < *b.it) && a.report > b.report);
+    };
+    std::make_heap(heads.begin(), heads.end(), later);
+    while (!heads.empty())
+    {
+        std::pop_heap(heads.begin(), heads.end(), later);
+        auto& head = heads.back();
+        auto entry = *head.it;
+        if (is_string(entry.type) && out.m_bucket == 0)
+            entry.bits += head.offset;
+        out.m_entries.push_back(entry);
+        if (++head.it == head.end)
+            heads.pop_back();
         else
-            throw(unknown_type(filter.type));
+            std::push_heap(heads.begin(), heads.end(), later);
     }
-    Report out;
-    for (auto& o: outs)
+    if (out.m_bucket > 0)
+        out.combine_counts();
+    return out;
+}
+
+Report Report::take_rows_before(std::streamoff address)
+{
+    // A bucket isn't finished until all of its rows are.
+    if (m_bucket > 0)
+        address -= address % m_bucket;
+    auto const split = std::partition_point(
+        m_entries.begin(), m_entries.end(),
+        [&](Entry const& entry) { return entry.address >> 4 < address >> 4; });
+    Report out(m_bucket);
+    if (split == m_entries.begin())
+        return out;
+    if (split == m_entries.end())
     {
-        auto const& report = o.get();
-        out.insert(report.begin(), report.end());
+        std::swap(out, *this);
+        return out;
     }
+    // Copy both parts so that the text of the strings that were taken isn't kept.
+    Report rest(m_bucket);
+    for (auto it = m_entries.begin(); it != split; ++it)
+        out.add(*this, *it);
+    for (auto it = split; it != m_entries.end(); ++it)
+        rest.add(*this, *it);
+    *this = std::move(rest);
     return out;
 }
 
-std::vector<std::string> format_report(Report const& report)
+std::string_view Report::text(Entry const& entry) const
+{
+    return std::string_view(m_text).substr(entry.bits, entry.length);
+}
+
+std::string Report::value(Entry const& entry) const
+{
+    if (m_bucket > 0)
+        return std::to_string(entry.bits);
+    Number_Buffer buffer;
+    return std::string(format_value(*this, entry, buffer));
+}
+
+void format_report(Report const& report,
+                   std::function<void(std::string_view)> const& write_line)
 {
     int constexpr addr_width = 8;
-    std::vector<std::string> out;
     Entry last_entry;
+    std::string last_value;
+    // The line being built. It's written when the next one starts because later entries
+    // may mark their LSDs on it.
+    std::string line;
+    Number_Buffer buffer;
     for (auto const& entry : report)
     {
-        auto const& [addr, value, type] = entry;
-        std::ostringstream pos;
-        pos << std::setfill('0') << std::setw(addr_width) << std::hex << addr;
-        auto lsd = pos.str()[7];
+        auto const addr = entry.address;
+        auto const type = entry.type;
+        // The address in hex, zero-padded to at least addr_width digits.
+        std::array<char, 2*sizeof(addr)> hex;
+        auto const hex_end = std::to_chars(hex.data(), hex.data() + hex.size(),
+                                           addr, 16).ptr;
+        auto const digits = static_cast<int>(hex_end - hex.data());
+        std::array<char, 2*sizeof(addr)> pos;
+        pos.fill('0');
+        std::copy(hex.data(), hex_end, pos.data() + std::max(addr_width - digits, 0));
+        auto lsd = pos[7];
         // If a value occurs multiple times on the same 16-byte line, show just one entry
         // in the report but mark the LSD of each address.
         bool same_line = addr >> 4 == last_entry.address >> 4;
-        if (same_line && type == last_entry.type && value == last_entry.value)
+        bool same_type = same_line && type == last_entry.type;
+        // Equal bits give equal numbers, so they don't need to be formatted.
+        if (same_type && !is_string(type) && entry.bits == last_entry.bits)
+        {
+            line[addr_width + (addr & 0xf)] = lsd;
+            continue;
+        }
+        auto const value = format_value(report, entry, buffer);
+        if (same_type && value == last_value)
         {
-            out.back()[addr_width + (addr & 0xf)] = lsd;
+            line[addr_width + (addr & 0xf)] = lsd;
             continue;
         }
+        if (last_entry.address != -1)
+            write_line(line);
         // Format the line.
-        std::ostringstream line;
+        line.clear();
         // Don't repeat the address if it's the same up to the LSD.
-        line << (last_entry.address != -1 && same_line
-                 ? std::string(addr_width - 1, ' ')
-                 : pos.str().substr(0, addr_width - 1))
-             << ' ';
-        // Show the LSD in its column.
-        std::string byte(0x12, ' '); // Include 2 characters of padding.
-        byte[addr & 0xf] = lsd;
-        line << byte
-             << std::setw(4) << std::left << type
-             << value;
-        out.push_back(line.str());
+        if (last_entry.address != -1 && same_line)
+            line.append(addr_width - 1, ' ');
+        else
+            line.append(pos.data(), addr_width - 1);
+        line += ' ';
+        // Show the LSD in its column. Include 2 characters of padding.
+        line.append(0x12, ' ');
+        line[addr_width + (addr & 0xf)] = lsd;
+        auto const name = type_names[static_cast<size_t>(type)];
+        line += name;
+        // Names are padded to 4 characters. Longer ones are followed by a space.
+        line.append(std::max<size_t>(std::strlen(name) + 1, 4) - std::strlen(name), ' ');
+        line += value;
         last_entry = entry;
+        last_value = value;
     }
+    if (last_entry.address != -1)
+        write_line(line);
+}
+
+std::vector<std::string> format_report(Report const& report)
+{
+    std::vector<std::string> out;
+    out.reserve(report.size());
+    format_report(report, [&](std::string_view line) { out.emplace_back(line); });
+    return out;
+}
+
+/// The width of a column of counts.
+int constexpr count_width = 12;
+
+/// Append text right-aligned in a column of counts.
+void append_column(std::string& line, std::string_view text)
+{
+    line.append(std::max<size_t>(count_width, text.size() + 1) - text.size(), ' ');
+    line += text;
+}
+
+std::string histogram_header(std::vector<Type> const& columns)
+{
+    std::string out = "address ";
+    for (auto type : columns)
+        append_column(out, type_names[static_cast<size_t>(type)]);
     return out;
 }
+
+void format_histogram(Report const& report, std::vector<Type> const& columns,
+                      std::function<void(std::string_view)> const& write_line)
+{
+    std::vector<std::uint64_t> counts(columns.size());
+    std::string line;
+    std::array<char, 24> digits;
+    auto const write_row = [&](std::streamoff address) {
+        line.clear();
+        auto end = std::to_chars(digits.data(), digits.data() + digits.size(),
+                                 address, 16).ptr;
+        line.append(std::max<std::ptrdiff_t>(8 - (end - digits.data()), 0), '0');
+        line.append(digits.data(), end);
+        for (auto& count : counts)
+        {
+            end = std::to_chars(digits.data(), digits.data() + digits.size(), count).ptr;
+            append_column(line, {digits.data(), static_cast<size_t>(end - digits.data())});
+            count = 0;
+        }
+        write_line(line);
+    };
+
+    std::streamoff address = -1;
+    for (auto const& entry : report)
+    {
+        if (entry.address != address && address != -1)
+            write_row(address);
+        address = entry.address;
+        auto column = std::find(columns.begin(), columns.end(), entry.type);
+        if (column != columns.end())
+            counts[column - columns.begin()] += entry.bits;
+    }
+    if (address != -1)
+        write_row(address);
+}
@@ -16,11 +16,16 @@
 #ifndef INSPECT_INSPECT_BINARY_INSPECT_HH_INCLUDED
 #define INSPECT_INSPECT_BINARY_INSPECT_HH_INCLUDED
 
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
+#include <functional>
 #include <stdexcept>
 #include <iosfwd>
+#include <span>
 #include <string>
-#include <set>
+#include <string_view>
 #include <vector>
 
 struct Range
@@ -35,26 +40,214 @@ struct Filter
 {
     std::string type;
     Range range;
+    /// Numbers are only looked for at offsets in the file that are 'phase' more than a
+    /// multiple of 'align'. 'align' must be a power of 2 and 'phase' less than it.
+    /// Strings may start anywhere.
+    std::size_t align = 1;
+    std::size_t phase = 0;
 };
 
 /// The complete specification about what to look for.
 using Spec = std::vector<Filter>;
 
-/// Information about a match in the binary file.
+/// The types of values that can be found, in order of their names. Matches in the same
+/// 16-byte row are shown in this order. Numbers are little-endian unless the name ends
+/// with "be".
+enum class Type : std::uint8_t
+{
+    a16,
+    a8,
+    f32,
+    f32be,
+    f64,
+    f64be,
+    i16,
+    i16be,
+    i32,
+    i32be,
+    i64,
+    i64be,
+    s16,
+    s8,
+};
+
+/// @return The name of the type as it's given on the command line.
+std::string to_string(Type type);
+/// @return The type with the given name. Throw unknown_type if there isn't one.
+Type to_type(std::string const& name);
+/// @return True for string types.
+bool is_string(Type type);
+/// @return True for numbers stored in big-endian byte order.
+bool is_big_endian(Type type);
+/// @return The number type with the same size and the other byte order.
+Type other_byte_order(Type type);
+
+/// Information about a match in the binary file. Entries are kept small because there
+/// may be many millions of them. Values are decoded when they're shown.
 struct Entry
 {
     std::streamoff address = -1;
-    std::string value;
-    std::string type;
+    /// The bits of a number, or the offset of a string's text in the report.
+    std::uint64_t bits = 0;
+    /// The number of characters in a string.
+    std::uint32_t length = 0;
+    Type type = Type::a16;
+};
+static_assert(sizeof(Entry) <= 24);
+
+/// Sort entries by stream position.
+inline bool operator<(Entry const& a, Entry const& b) noexcept
+{
+    auto a_addr = a.address >> 4;
+    auto b_addr = b.address >> 4;
+    // Sort by 16-byte "row". Sort by name of type within a row.  Note that this may put
+    // some entries out of address order, but allows a more orderly presentation with
+    // groping of repeated values.
+    return a_addr < b_addr || (a_addr == b_addr && a.type < b.type);
+}
+
+/// All of the matches found, sorted by position, and the text of the strings. Entries
+/// are kept in a vector, so they must be added in order. Filters find matches in address
+/// order, and reports from different filters are combined with merge().
+///
+/// A report may count matches instead. Then there's an entry for each bucket of addresses
+/// and type that has matches. Its address is the start of the bucket and its bits are the
+/// count.
+class Report
+{
+public:
+    using const_iterator = std::vector<Entry>::const_iterator;
+
+    /// @param bucket If not 0, count matches in buckets of this many bytes instead of
+    ///    keeping them. Must be 0 or at least 16 so that buckets are in different rows.
+    /// @param origin Added to the addresses of matches that are added.
+    explicit Report(std::streamoff bucket = 0, std::streamoff origin = 0)
+        : m_bucket(bucket),
+          m_origin(origin)
+    {
+        assert(bucket == 0 || bucket >= 16);
+    }
+
+    const_iterator begin() const { return m_entries.begin(); }
+    const_iterator end() const { return m_entries.end(); }
+    std::size_t size() const { return m_entries.size(); }
+    bool empty() const { return m_entries.empty(); }
+
+    /// Add a number. It must not sort before the last entry.
+    template <typename T>
+    void add_number(std::streamoff address, Type type, T value)
+    {
+        address += m_origin;
+        if (m_bucket > 0)
+            return add_count(address, type, 1);
+        Entry entry{address, 0, 0, type};
+        std::memcpy(&entry.bits, &value, sizeof value);
+        assert(m_entries.empty() || !(entry < m_entries.back()));
+        m_entries.push_back(entry);
+    }
+    /// Count a number of the type at the address of each bit set in 'mask'. Bit i of
+    /// word w is at 'address' + 64*w + i. The report must count.
+    /// @param count The number of addresses that the mask covers.
+    void count_numbers(std::streamoff address, Type type, std::uint64_t const* mask,
+                       std::size_t count);
+    /// Add a string. It must not sort before the last entry.
+    void add_string(std::streamoff address, Type type, std::string_view text);
+    /// Add an entry from another report. Its address isn't changed. It must not sort
+    /// before the last entry.
+    void add(Report const& other, Entry const& entry);
+    /// Add all of the entries from another report. Entries that sort the same stay in the
+    /// order of the reports.
+    void merge(Report const& other);
+    /// @return The entries of all of the reports in order. Entries that sort the same
+    ///    stay in the order of the reports.
+    static Report merge(std::vector<Report> const& reports);
+    /// Remove the entries in the rows before the one with the given address.
+    /// @return The entries that were removed.
+    Report take_rows_before(std::streamoff address);
+
+    /// @return The size of the buckets that matches are counted in, or 0 if they're kept.
+    std::streamoff bucket() const { return m_bucket; }
+    /// @return The offset that's added to the addresses of matches.
+    std::streamoff origin() const { return m_origin; }
+    /// @return The text of a string entry.
+    std::string_view text(Entry const& entry) const;
+    /// @return The value of an entry formatted for display. For a report that counts, the
+    ///    count.
+    std::string value(Entry const& entry) const;
+
+private:
+    /// Add to the count of matches in the bucket with the address.
+    void add_count(std::streamoff address, Type type, std::uint64_t count);
+    /// Combine the counts of entries with the same bucket and type.
+    void combine_counts();
+
+    std::streamoff m_bucket;
+    std::streamoff m_origin;
+    std::vector<Entry> m_entries;
+    std::string m_text; ///< The text of all of the strings.
+};
+
+/// How the data is read while looking for matches.
+enum class Engine
+{
+    stream, ///< Read through a std::istream. Slow, but simple enough to be the reference.
+    buffer, ///< Step a pointer through memory.
+    fused,  ///< Step a pointer through memory once for all filters.
+};
+
+/// How to look for matches.
+struct Settings
+{
+    Engine engine = Engine::fused;
+    /// The number of threads that scan the data with the fused engine. 0 means one per
+    /// CPU. The matches are the same for any number.
+    unsigned jobs = 0;
+    /// The largest number of bytes scanned at a time by the fused engine. Matches are
+    /// passed on after each window. Windows start small and grow to this size so that
+    /// early matches are found quickly. When reading a stream, memory use is bounded by
+    /// this plus the size of the report.
+    std::size_t window = 64 << 20;
+    /// If not 0, count matches in buckets of this many bytes instead of keeping them. At
+    /// least 16.
+    std::streamoff bucket = 0;
+    /// The offset in the file of the data that's scanned. It's added to the addresses of
+    /// matches, so buckets and rows are the file's.
+    std::streamoff origin = 0;
 };
 
-/// All of the matches found.
-using Report = std::multiset<Entry>;
+/// Called with the matches found so far, in order, as they become final. Each call has
+/// whole 16-byte rows that come after the rows of the previous call.
+/// @return False to stop the scan.
+using Report_Sink = std::function<bool(Report const&)>;
 
-/// @return all matches for all filters sorted by stream position.
-Report inspect(std::istream& is, Spec const& spec);
+/// @return all matches for all filters sorted by stream position. The fused engine reads
+///    the stream one window at a time. The other engines read all of it first.
+Report inspect(std::istream& is, Spec const& spec, Settings const& settings = {});
+/// @return all matches for all filters sorted by position in the data. The data is shared
+///    by all filters without being copied.
+Report inspect(std::span<std::byte const> data, Spec const& spec,
+               Settings const& settings = {});
+/// Send all matches for all filters to 'sink' while the stream is read, until it returns
+/// false. The fused engine passes them on after each window. The other engines pass them
+/// on at the end.
+void inspect(std::istream& is, Spec const& spec, Settings const& settings,
+             Report_Sink const& sink);
+/// Send all matches for all filters to 'sink' while the data is scanned.
+void inspect(std::span<std::byte const> data, Spec const& spec, Settings const& settings,
+             Report_Sink const& sink);
 /// Format the matches for display.
 std::vector<std::string> format_report(Report const& report);
+/// Format the matches for display a line at a time, without newlines. The text passed
+/// to write_line() is only valid during the call.
+void format_report(Report const& report,
+                   std::function<void(std::string_view)> const& write_line);
+/// @return The heading for a table of counts with a column for each of the types.
+std::string histogram_header(std::vector<Type> const& columns);
+/// Format the counts in a report from Settings::bucket as a table with a row for each
+/// bucket that has matches and a column for each of the types. Lines are passed to
+/// write_line() as for format_report().
+void format_histogram(Report const& report, std::vector<Type> const& columns,
+                      std::function<void(std::string_view)> const& write_line);
 
 /// Exception raised when the range is empty.
 struct unknown_type : public std::runtime_error
@@ -0,0 +1,926 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "kernels.hh"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define INSPECT_X86
+#include <immintrin.h>
+#endif
+
+// The vector kernels test W consecutive offsets per iteration, where W is the vector
+// width in bytes. For each byte k of a T they load a vector starting k bytes into the
+// block. Lane j of that vector holds the T at offset k + j*sizeof(T). The compare result
+// is reduced to one bit per byte with movemask (or comes from a mask compare in AVX-512)
+// and the bits for offsets k, k + sizeof(T), ... are kept. ORing over k gives a bit for
+// every offset.
+//
+// Numbers in the other byte order are tested by reversing the bytes in each lane with a
+// byte shuffle. A kernel can test both byte orders of each vector it loads.
+//
+// When only aligned offsets are tested, only some values of k are needed. The kernels
+// are specialized on the number of loads, Loads, and test k = first + m*sizeof(T)/Loads
+// for m < Loads. An aligned i64 scan does one load per 8 offsets.
+//
+// Narrow integer ranges fix some bytes of the numbers in them. Every i32 in [-1000, 1000]
+// has 0x00 or 0xff in its top two bytes, for instance. Those bytes are tested for 64
+// offsets at a time with one load and a compare per byte. Only the offsets that pass go
+// on to the full test, which is skipped for most of the data when it's random.
+//
+// Floating point ranges bound the exponent instead. Every f64 with a magnitude in
+// [1e3, 1e6] has 0x40 or 0x41 in its top byte once the sign bit is masked off. Zero is
+// let through separately. The filter is only used when it's expected to skip most
+// vectors. A wide range like the default one for f64 passes too many random offsets.
+
+/// @return A mask with the LSB of every sizeof(T)-bit group set.
+template <typename T>
+std::uint64_t constexpr lane_starts()
+{
+    return sizeof(T) == 2 ? 0x5555555555555555
+        : sizeof(T) == 4 ? 0x1111111111111111
+        : 0x0101010101010101;
+}
+
+/// A test of the byte at 'offset' in a number. The byte is ANDed with 'mask' and passes if
+/// it's in [low, low + span] modulo 256, so 0xff and 0x00 can pass together. If 'zero' is
+/// true, it also passes if it's zero after masking.
+struct Byte_Test
+{
+    unsigned offset;
+    std::uint8_t low;
+    std::uint8_t span;
+    std::uint8_t mask = 0xff;
+    bool zero = false;
+};
+
+/// Byte tests that every number in a range passes.
+struct Byte_Filter
+{
+    /// The number of tests. 0 if there's no filter.
+    unsigned count = 0;
+    std::array<Byte_Test, 2> tests{};
+    /// The fraction of offsets in random data that pass.
+    double passed = 1;
+};
+
+/// @return The most selective byte tests for numbers of type T in the range. See
+///    Range_Test.
+/// @param swap If true, the numbers are in the other byte order.
+template <typename T>
+Byte_Filter byte_filter(T low, T high, T min, bool swap)
+{
+    Byte_Filter out;
+    if constexpr (std::is_integral_v<T>)
+    {
+        std::array<Byte_Test, sizeof(T)> tests;
+        for (unsigned k = 0; k < sizeof(T); ++k)
+        {
+            // The numbers in the range shifted down by k bytes are in [low, high], so
+            // byte k is in [low, high] modulo 256. The difference may not fit in an
+            // int64_t, but it's never negative, so it's taken without a sign.
+            auto const shifted_low = std::int64_t(low) >> 8*k;
+            auto const span = std::min<std::uint64_t>(
+                std::uint64_t(std::int64_t(high) >> 8*k) - std::uint64_t(shifted_low), 0xff);
+            tests[k] = {swap ? unsigned(sizeof(T)) - 1 - k : k, std::uint8_t(shifted_low),
+                        std::uint8_t(span)};
+        }
+        std::stable_sort(tests.begin(), tests.end(), [](auto const& t1, auto const& t2) {
+            return t1.span < t2.span;
+        });
+        for (; out.count < out.tests.size() && tests[out.count].span < 0xff; ++out.count)
+        {
+            out.tests[out.count] = tests[out.count];
+            out.passed *= (tests[out.count].span + 1) / 256.0;
+        }
+    }
+    else
+    {
+        // The top byte without the sign bit holds the top of the exponent. It bounds the
+        // magnitude, which is ordered like the bits of a positive number. NaNs and
+        // infinities have the largest top byte, zeros and denormals the smallest.
+        using Bits = std::conditional_t<sizeof(T) == 4, std::uint32_t, std::uint64_t>;
+        auto const top = [](T magnitude) {
+            return std::uint8_t(std::bit_cast<Bits>(magnitude) >> (8*sizeof(T) - 8));
+        };
+        if (!(low <= high))
+            return out;
+        auto const big = std::max(std::abs(low), std::abs(high));
+        auto const small = std::min(big, std::max(low > 0 ? low : high < 0 ? -high : T(0),
+                                                  std::abs(min)));
+        Byte_Test test{swap ? 0 : unsigned(sizeof(T)) - 1, top(small),
+                       std::uint8_t(top(big) - top(small)), 0x7f};
+        // Zero is in the range even if it's not in the band.
+        test.zero = low <= 0 && 0 <= high && test.low > 0;
+        out.tests[out.count++] = test;
+        out.passed = (test.span + 1 + test.zero) / 128.0;
+    }
+    return out;
+}
+
+/// A range that a kernel tests numbers against and the mask that gets the matches.
+template <typename T>
+struct Range_Test
+{
+    T low;
+    T high;
+    T min; ///< Only used for floating point.
+    std::uint64_t* mask;
+    /// Vectors where no offset passes the filter are skipped.
+    Byte_Filter filter = {};
+};
+
+/// @return True if the value is in the test's range.
+template <typename T>
+bool in_range(T value, Range_Test<T> const& test)
+{
+    if constexpr (std::is_floating_point_v<T>)
+        return test.low <= value && value <= test.high
+            && (std::abs(value) >= test.min || value == 0);
+    else
+        return test.low <= value && value <= test.high;
+}
+
+/// @return True if the number at 'data' is in the test's range.
+/// @param swap If true, reverse the bytes of the number before testing it.
+template <typename T>
+bool match_one(std::byte const* data, Range_Test<T> const& test, bool swap)
+{
+    T value;
+    std::memcpy(&value, data, sizeof value);
+    return in_range(swap ? byte_swap(value) : value, test);
+}
+
+/// Test the offsets in the stride one at a time from 'begin' to 'count'.
+/// @param swap If true, reverse the bytes of each number before testing it.
+template <typename T>
+void match_range_scalar(std::byte const* data, std::size_t begin, std::size_t count,
+                        Range_Test<T> const& test, bool swap, Stride const& stride)
+{
+    auto const first = begin + (stride.phase + stride.align - begin % stride.align)
+        % stride.align;
+    for (auto i = first; i < count; i += stride.align)
+        if (match_one(data + i, test, swap))
+            test.mask[i / 64] |= std::uint64_t(1) << (i % 64);
+}
+
+#ifdef INSPECT_X86
+/// @return The index of each byte after reversing the bytes of each T in 16 bytes.
+template <typename T>
+std::array<std::uint8_t, 16> constexpr swap_indexes()
+{
+    std::array<std::uint8_t, 16> out{};
+    for (std::size_t i = 0; i < out.size(); ++i)
+        out[i] = i / sizeof(T) * sizeof(T) + sizeof(T) - 1 - i % sizeof(T);
+    return out;
+}
+
+/// @return Bits set for the bytes of the lanes of 'v' that are in the test's range.
+template <typename T>
+__attribute__((target("sse4.2")))
+inline std::uint32_t match_lanes_sse4_2(__m128i v, Range_Test<T> const& test)
+{
+    __m128i out;
+    if constexpr (std::is_same_v<T, float>)
+    {
+        auto f = _mm_castsi128_ps(v);
+        auto abs = _mm_andnot_ps(_mm_set1_ps(-0.0f), f);
+        out = _mm_castps_si128(_mm_and_ps(
+            _mm_and_ps(_mm_cmpge_ps(f, _mm_set1_ps(test.low)),
+                       _mm_cmple_ps(f, _mm_set1_ps(test.high))),
+            _mm_or_ps(_mm_cmpge_ps(abs, _mm_set1_ps(test.min)),
+                      _mm_cmpeq_ps(f, _mm_setzero_ps()))));
+    }
+    else if constexpr (std::is_same_v<T, double>)
+    {
+        auto f = _mm_castsi128_pd(v);
+        auto abs = _mm_andnot_pd(_mm_set1_pd(-0.0), f);
+        out = _mm_castpd_si128(_mm_and_pd(
+            _mm_and_pd(_mm_cmpge_pd(f, _mm_set1_pd(test.low)),
+                       _mm_cmple_pd(f, _mm_set1_pd(test.high))),
+            _mm_or_pd(_mm_cmpge_pd(abs, _mm_set1_pd(test.min)),
+                      _mm_cmpeq_pd(f, _mm_setzero_pd()))));
+    }
+    else if constexpr (sizeof(T) == 2)
+        out = _mm_or_si128(_mm_cmpgt_epi16(_mm_set1_epi16(test.low), v),
+                           _mm_cmpgt_epi16(v, _mm_set1_epi16(test.high)));
+    else if constexpr (sizeof(T) == 4)
+        out = _mm_or_si128(_mm_cmpgt_epi32(_mm_set1_epi32(test.low), v),
+                           _mm_cmpgt_epi32(v, _mm_set1_epi32(test.high)));
+    else
+        out = _mm_or_si128(_mm_cmpgt_epi64(_mm_set1_epi64x(test.low), v),
+                           _mm_cmpgt_epi64(v, _mm_set1_epi64x(test.high)));
+    // The integer compares find the lanes that are out of range.
+    auto const bits = std::uint32_t(_mm_movemask_epi8(out));
+    return std::is_floating_point_v<T> ? bits : ~bits;
+}
+
+/// @return True if no offset in the 16 from 'data' passes the filter.
+__attribute__((target("sse4.2")))
+inline bool filtered_out_sse4_2(std::byte const* data, Byte_Filter const& filter)
+{
+    auto pass = _mm_set1_epi8(-1);
+    for (unsigned t = 0; t < filter.count; ++t)
+    {
+        auto const& test = filter.tests[t];
+        auto v = _mm_and_si128(
+            _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + test.offset)),
+            _mm_set1_epi8(test.mask));
+        auto d = _mm_sub_epi8(v, _mm_set1_epi8(test.low));
+        auto in = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(test.span)), d);
+        if (test.zero)
+            in = _mm_or_si128(in, _mm_cmpeq_epi8(v, _mm_setzero_si128()));
+        pass = _mm_and_si128(pass, in);
+    }
+    return _mm_testz_si128(pass, pass);
+}
+
+/// @return The number of offsets tested, a multiple of 16.
+/// @param Native, Swapped Which tests to run: 'native' on the numbers as they're stored,
+///    'swapped' on the numbers with their bytes reversed.
+/// @param Loads, first The loads to do for each vector. See above.
+template <typename T, bool Native, bool Swapped, std::size_t Loads>
+__attribute__((target("sse4.2")))
+std::size_t match_range_sse4_2(std::byte const* data, std::size_t count,
+                               Range_Test<T> const& native, Range_Test<T> const& swapped,
+                               std::size_t first)
+{
+    auto const swap = _mm_loadu_si128(
+        reinterpret_cast<__m128i const*>(swap_indexes<T>().data()));
+    std::size_t i = 0;
+    for (; i + 16 <= count; i += 16)
+    {
+        if ((!Native || filtered_out_sse4_2(data + i, native.filter))
+            && (!Swapped || filtered_out_sse4_2(data + i, swapped.filter)))
+            continue;
+        std::uint32_t bits = 0;
+        std::uint32_t swapped_bits = 0;
+        for (std::size_t m = 0; m < Loads; ++m)
+        {
+            auto const k = first + m * (sizeof(T) / Loads);
+            auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i + k));
+            if constexpr (Native)
+                bits |= match_lanes_sse4_2(v, native) & (lane_starts<T>() << k);
+            if constexpr (Swapped)
+                swapped_bits |= match_lanes_sse4_2(_mm_shuffle_epi8(v, swap), swapped)
+                    & (lane_starts<T>() << k);
+        }
+        if constexpr (Native)
+            native.mask[i / 64] |= std::uint64_t(bits & 0xffff) << (i % 64);
+        if constexpr (Swapped)
+            swapped.mask[i / 64] |= std::uint64_t(swapped_bits & 0xffff) << (i % 64);
+    }
+    return i;
+}
+
+/// @return Bits set for the bytes of the lanes of 'v' that are in the test's range.
+template <typename T>
+__attribute__((target("avx2")))
+inline std::uint32_t match_lanes_avx2(__m256i v, Range_Test<T> const& test)
+{
+    __m256i out;
+    if constexpr (std::is_same_v<T, float>)
+    {
+        auto f = _mm256_castsi256_ps(v);
+        auto abs = _mm256_andnot_ps(_mm256_set1_ps(-0.0f), f);
+        out = _mm256_castps_si256(_mm256_and_ps(
+            _mm256_and_ps(_mm256_cmp_ps(f, _mm256_set1_ps(test.low), _CMP_GE_OQ),
+                          _mm256_cmp_ps(f, _mm256_set1_ps(test.high), _CMP_LE_OQ)),
+            _mm256_or_ps(_mm256_cmp_ps(abs, _mm256_set1_ps(test.min), _CMP_GE_OQ),
+                         _mm256_cmp_ps(f, _mm256_setzero_ps(), _CMP_EQ_OQ))));
+    }
+    else if constexpr (std::is_same_v<T, double>)
+    {
+        auto f = _mm256_castsi256_pd(v);
+        auto abs = _mm256_andnot_pd(_mm256_set1_pd(-0.0), f);
+        out = _mm256_castpd_si256(_mm256_and_pd(
+            _mm256_and_pd(_mm256_cmp_pd(f, _mm256_set1_pd(test.low), _CMP_GE_OQ),
+                          _mm256_cmp_pd(f, _mm256_set1_pd(test.high), _CMP_LE_OQ)),
+            _mm256_or_pd(_mm256_cmp_pd(abs, _mm256_set1_pd(test.min), _CMP_GE_OQ),
+                         _mm256_cmp_pd(f, _mm256_setzero_pd(), _CMP_EQ_OQ))));
+    }
+    else if constexpr (sizeof(T) == 2)
+        out = _mm256_or_si256(_mm256_cmpgt_epi16(_mm256_set1_epi16(test.low), v),
+                              _mm256_cmpgt_epi16(v, _mm256_set1_epi16(test.high)));
+    else if constexpr (sizeof(T) == 4)
+        out = _mm256_or_si256(_mm256_cmpgt_epi32(_mm256_set1_epi32(test.low), v),
+                              _mm256_cmpgt_epi32(v, _mm256_set1_epi32(test.high)));
+    else
+        out = _mm256_or_si256(_mm256_cmpgt_epi64(_mm256_set1_epi64x(test.low), v),
+                              _mm256_cmpgt_epi64(v, _mm256_set1_epi64x(test.high)));
+    // The integer compares find the lanes that are out of range.
+    auto const bits = std::uint32_t(_mm256_movemask_epi8(out));
+    return std::is_floating_point_v<T> ? bits : ~bits;
+}
+
+/// @return True if no offset in the 32 from 'data' passes the filter.
+__attribute__((target("avx2")))
+inline bool filtered_out_avx2(std::byte const* data, Byte_Filter const& filter)
+{
+    auto pass = _mm256_set1_epi8(-1);
+    for (unsigned t = 0; t < filter.count; ++t)
+    {
+        auto const& test = filter.tests[t];
+        auto v = _mm256_and_si256(
+            _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + test.offset)),
+            _mm256_set1_epi8(test.mask));
+        auto d = _mm256_sub_epi8(v, _mm256_set1_epi8(test.low));
+        auto in = _mm256_cmpeq_epi8(_mm256_min_epu8(d, _mm256_set1_epi8(test.span)), d);
+        if (test.zero)
+            in = _mm256_or_si256(in, _mm256_cmpeq_epi8(v, _mm256_setzero_si256()));
+        pass = _mm256_and_si256(pass, in);
+    }
+    return _mm256_testz_si256(pass, pass);
+}
+
+/// @return The number of offsets tested, a multiple of 32.
+template <typename T, bool Native, bool Swapped, std::size_t Loads>
+__attribute__((target("avx2")))
+std::size_t match_range_avx2(std::byte const* data, std::size_t count,
+                             Range_Test<T> const& native, Range_Test<T> const& swapped,
+                             std::size_t first)
+{
+    auto const swap = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(swap_indexes<T>().data())));
+    std::size_t i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        if ((!Native || filtered_out_avx2(data + i, native.filter))
+            && (!Swapped || filtered_out_avx2(data + i, swapped.filter)))
+            continue;
+        std::uint32_t bits = 0;
+        std::uint32_t swapped_bits = 0;
+        for (std::size_t m = 0; m < Loads; ++m)
+        {
+            auto const k = first + m * (sizeof(T) / Loads);
+            auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + i + k));
+            if constexpr (Native)
+                bits |= match_lanes_avx2(v, native) & (lane_starts<T>() << k);
+            if constexpr (Swapped)
+                swapped_bits |= match_lanes_avx2(_mm256_shuffle_epi8(v, swap), swapped)
+                    & (lane_starts<T>() << k);
+        }
+        if constexpr (Native)
+            native.mask[i / 64] |= std::uint64_t(bits) << (i % 64);
+        if constexpr (Swapped)
+            swapped.mask[i / 64] |= std::uint64_t(swapped_bits) << (i % 64);
+    }
+    return i;
+}
+
+/// @return One bit per lane of 'v', set if the lane is in the test's range.
+template <typename T>
+__attribute__((target("avx512f,avx512bw,bmi2")))
+inline std::uint64_t match_lanes_avx512(__m512i v, Range_Test<T> const& test)
+{
+    if constexpr (std::is_same_v<T, float>)
+    {
+        auto f = _mm512_castsi512_ps(v);
+        auto in = _mm512_mask_cmp_ps_mask(
+            _mm512_cmp_ps_mask(f, _mm512_set1_ps(test.low), _CMP_GE_OQ),
+            f, _mm512_set1_ps(test.high), _CMP_LE_OQ);
+        auto big = _mm512_cmp_ps_mask(_mm512_abs_ps(f), _mm512_set1_ps(test.min),
+                                      _CMP_GE_OQ);
+        auto zero = _mm512_cmp_ps_mask(f, _mm512_setzero_ps(), _CMP_EQ_OQ);
+        return in & (big | zero);
+    }
+    else if constexpr (std::is_same_v<T, double>)
+    {
+        auto f = _mm512_castsi512_pd(v);
+        auto in = _mm512_mask_cmp_pd_mask(
+            _mm512_cmp_pd_mask(f, _mm512_set1_pd(test.low), _CMP_GE_OQ),
+            f, _mm512_set1_pd(test.high), _CMP_LE_OQ);
+        auto big = _mm512_cmp_pd_mask(_mm512_abs_pd(f), _mm512_set1_pd(test.min),
+                                      _CMP_GE_OQ);
+        auto zero = _mm512_cmp_pd_mask(f, _mm512_setzero_pd(), _CMP_EQ_OQ);
+        return in & (big | zero);
+    }
+    else if constexpr (sizeof(T) == 2)
+        return _mm512_mask_cmple_epi16_mask(
+            _mm512_cmpge_epi16_mask(v, _mm512_set1_epi16(test.low)),
+            v, _mm512_set1_epi16(test.high));
+    else if constexpr (sizeof(T) == 4)
+        return _mm512_mask_cmple_epi32_mask(
+            _mm512_cmpge_epi32_mask(v, _mm512_set1_epi32(test.low)),
+            v, _mm512_set1_epi32(test.high));
+    else
+        return _mm512_mask_cmple_epi64_mask(
+            _mm512_cmpge_epi64_mask(v, _mm512_set1_epi64(test.low)),
+            v, _mm512_set1_epi64(test.high));
+}
+
+/// @return True if no offset in the 64 from 'data' passes the filter.
+__attribute__((target("avx512f,avx512bw,bmi2")))
+inline bool filtered_out_avx512(std::byte const* data, Byte_Filter const& filter)
+{
+    auto pass = ~std::uint64_t(0);
+    for (unsigned t = 0; t < filter.count; ++t)
+    {
+        auto const& test = filter.tests[t];
+        auto v = _mm512_and_si512(_mm512_loadu_si512(data + test.offset),
+                                  _mm512_set1_epi8(test.mask));
+        auto in = _mm512_cmple_epu8_mask(_mm512_sub_epi8(v, _mm512_set1_epi8(test.low)),
+                                         _mm512_set1_epi8(test.span));
+        if (test.zero)
+            in |= _mm512_testn_epi8_mask(v, v);
+        pass &= in;
+    }
+    return pass == 0;
+}
+
+/// @return The number of offsets tested, a multiple of 64.
+template <typename T, bool Native, bool Swapped, std::size_t Loads>
+__attribute__((target("avx512f,avx512bw,bmi2")))
+std::size_t match_range_avx512(std::byte const* data, std::size_t count,
+                               Range_Test<T> const& native, Range_Test<T> const& swapped,
+                               std::size_t first)
+{
+    // The unmasked broadcast triggers a spurious -Wuninitialized in GCC's headers.
+    auto const swap = _mm512_mask_broadcast_i32x4(
+        _mm512_setzero_si512(), 0xffff,
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(swap_indexes<T>().data())));
+    std::size_t i = 0;
+    for (; i + 64 <= count; i += 64)
+    {
+        if ((!Native || filtered_out_avx512(data + i, native.filter))
+            && (!Swapped || filtered_out_avx512(data + i, swapped.filter)))
+            continue;
+        std::uint64_t bits = 0;
+        std::uint64_t swapped_bits = 0;
+        for (std::size_t m = 0; m < Loads; ++m)
+        {
+            auto const k = first + m * (sizeof(T) / Loads);
+            auto v = _mm512_loadu_si512(data + i + k);
+            // One mask bit per lane. Spread them out to one bit per T.
+            if constexpr (Native)
+                bits |= _pdep_u64(match_lanes_avx512(v, native), lane_starts<T>()) << k;
+            if constexpr (Swapped)
+                swapped_bits |= _pdep_u64(
+                    match_lanes_avx512(_mm512_shuffle_epi8(v, swap), swapped),
+                    lane_starts<T>()) << k;
+        }
+        if constexpr (Native)
+            native.mask[i / 64] |= bits;
+        if constexpr (Swapped)
+            swapped.mask[i / 64] |= swapped_bits;
+    }
+    return i;
+}
+
+// Bytes are classified by looking up their low and high nibbles in the charset's tables
+// with byte shuffles and ANDing the results.
+
+/// @return The number of bytes classified, a multiple of 64.
+__attribute__((target("sse4.2")))
+std::size_t classify_sse4_2(std::byte const* data, std::size_t count, Charset const& charset,
+                            std::uint64_t* const* printable, std::uint64_t* terminator,
+                            std::uint64_t* zero)
+{
+    auto const lo = _mm_loadu_si128(reinterpret_cast<__m128i const*>(charset.lo().data()));
+    auto const hi = _mm_loadu_si128(reinterpret_cast<__m128i const*>(charset.hi().data()));
+    auto const nibble = _mm_set1_epi8(0x0f);
+    std::size_t i = 0;
+    for (; i + 64 <= count; i += 64)
+    {
+        std::array<std::uint64_t, Charset::max_size> p{};
+        std::uint64_t t = 0, z = 0;
+        for (std::size_t part = 0; part < 64; part += 16)
+        {
+            auto v = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i + part));
+            auto cls = _mm_and_si128(
+                _mm_shuffle_epi8(lo, _mm_and_si128(v, nibble)),
+                _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(v, 4), nibble)));
+            for (std::size_t set = 0; set < charset.size(); ++set)
+            {
+                auto not_print = _mm_cmpeq_epi8(
+                    _mm_and_si128(cls, _mm_set1_epi8(charset.bits(set))),
+                    _mm_setzero_si128());
+                p[set] |= std::uint64_t(~_mm_movemask_epi8(not_print) & 0xffff) << part;
+            }
+            t |= std::uint64_t(_mm_movemask_epi8(cls)) << part;
+            z |= std::uint64_t(_mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_setzero_si128())))
+                << part;
+        }
+        for (std::size_t set = 0; set < charset.size(); ++set)
+            printable[set][i / 64] = p[set];
+        terminator[i / 64] = t;
+        zero[i / 64] = z;
+    }
+    return i;
+}
+
+/// @return The number of bytes classified, a multiple of 64.
+__attribute__((target("avx2")))
+std::size_t classify_avx2(std::byte const* data, std::size_t count, Charset const& charset,
+                          std::uint64_t* const* printable, std::uint64_t* terminator,
+                          std::uint64_t* zero)
+{
+    auto const lo = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(charset.lo().data())));
+    auto const hi = _mm256_broadcastsi128_si256(
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(charset.hi().data())));
+    auto const nibble = _mm256_set1_epi8(0x0f);
+    std::size_t i = 0;
+    for (; i + 64 <= count; i += 64)
+    {
+        std::array<std::uint64_t, Charset::max_size> p{};
+        std::uint64_t t = 0, z = 0;
+        for (std::size_t part = 0; part < 64; part += 32)
+        {
+            auto v = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + i + part));
+            auto cls = _mm256_and_si256(
+                _mm256_shuffle_epi8(lo, _mm256_and_si256(v, nibble)),
+                _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble)));
+            for (std::size_t set = 0; set < charset.size(); ++set)
+            {
+                auto not_print = _mm256_cmpeq_epi8(
+                    _mm256_and_si256(cls, _mm256_set1_epi8(charset.bits(set))),
+                    _mm256_setzero_si256());
+                p[set] |= std::uint64_t(~std::uint32_t(_mm256_movemask_epi8(not_print)))
+                    << part;
+            }
+            t |= std::uint64_t(std::uint32_t(_mm256_movemask_epi8(cls))) << part;
+            auto is_zero = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+            z |= std::uint64_t(std::uint32_t(_mm256_movemask_epi8(is_zero))) << part;
+        }
+        for (std::size_t set = 0; set < charset.size(); ++set)
+            printable[set][i / 64] = p[set];
+        terminator[i / 64] = t;
+        zero[i / 64] = z;
+    }
+    return i;
+}
+
+/// @return The number of bytes classified, a multiple of 64.
+__attribute__((target("avx512f,avx512bw,bmi2")))
+std::size_t classify_avx512(std::byte const* data, std::size_t count,
+                            Charset const& charset, std::uint64_t* const* printable,
+                            std::uint64_t* terminator, std::uint64_t* zero)
+{
+    // The unmasked broadcast triggers a spurious -Wuninitialized in GCC's headers.
+    auto const lo = _mm512_mask_broadcast_i32x4(
+        _mm512_setzero_si512(), 0xffff,
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(charset.lo().data())));
+    auto const hi = _mm512_mask_broadcast_i32x4(
+        _mm512_setzero_si512(), 0xffff,
+        _mm_loadu_si128(reinterpret_cast<__m128i const*>(charset.hi().data())));
+    auto const nibble = _mm512_set1_epi8(0x0f);
+    std::size_t i = 0;
+    for (; i + 64 <= count; i += 64)
+    {
+        auto v = _mm512_loadu_si512(data + i);
+        auto cls = _mm512_and_si512(
+            _mm512_shuffle_epi8(lo, _mm512_and_si512(v, nibble)),
+            _mm512_shuffle_epi8(hi, _mm512_and_si512(_mm512_srli_epi16(v, 4), nibble)));
+        for (std::size_t set = 0; set < charset.size(); ++set)
+            printable[set][i / 64]
+                = _mm512_test_epi8_mask(cls, _mm512_set1_epi8(charset.bits(set)));
+        terminator[i / 64] = _mm512_movepi8_mask(cls);
+        zero[i / 64] = _mm512_testn_epi8_mask(v, v);
+    }
+    return i;
+}
+
+/// @return The number of offsets listed. All of the mask is done.
+__attribute__((target("avx512f,popcnt")))
+std::size_t mask_offsets_avx512(std::uint64_t const* mask, std::size_t count,
+                                std::uint32_t* offsets)
+{
+    // Store the lanes of a vector of offsets that have their bits set, 16 bits at a
+    // time. The next store starts after the ones that were stored.
+    auto const step = _mm512_set1_epi32(16);
+    auto index = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    auto out = offsets;
+    for (std::size_t word = 0; word < (count + 63) / 64; ++word)
+    {
+        auto const bits = mask[word];
+        if (bits == 0)
+        {
+            index = _mm512_add_epi32(index, _mm512_set1_epi32(64));
+            continue;
+        }
+        for (int part = 0; part < 4; ++part)
+        {
+            auto const lanes = static_cast<__mmask16>(bits >> 16*part);
+            _mm512_mask_compressstoreu_epi32(out, lanes, index);
+            out += std::popcount(lanes);
+            index = _mm512_add_epi32(index, step);
+        }
+    }
+    return out - offsets;
+}
+
+#endif
+
+/// The instruction set used by the kernels.
+static Isa isa = supported_isa();
+
+Isa supported_isa()
+{
+#ifdef INSPECT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")
+        && __builtin_cpu_supports("bmi2"))
+        return Isa::avx512;
+    if (__builtin_cpu_supports("avx2"))
+        return Isa::avx2;
+    if (__builtin_cpu_supports("sse4.2"))
+        return Isa::sse4_2;
+#endif
+    return Isa::scalar;
+}
+
+Isa use_isa(Isa new_isa)
+{
+    isa = std::min(new_isa, supported_isa());
+    return isa;
+}
+
+/// Run the vector kernel for the instruction set in use.
+/// @return The number of offsets tested.
+template <typename T, bool Native, bool Swapped, std::size_t Loads>
+std::size_t match_vectors(std::byte const* data, std::size_t count,
+                          Range_Test<T> const& native, Range_Test<T> const& swapped,
+                          std::size_t first)
+{
+#ifdef INSPECT_X86
+    switch (isa)
+    {
+    case Isa::avx512:
+        return match_range_avx512<T, Native, Swapped, Loads>(data, count, native, swapped,
+                                                             first);
+    case Isa::avx2:
+        return match_range_avx2<T, Native, Swapped, Loads>(data, count, native, swapped,
+                                                           first);
+    case Isa::sse4_2:
+        return match_range_sse4_2<T, Native, Swapped, Loads>(data, count, native, swapped,
+                                                             first);
+    case Isa::scalar:
+        break;
+    }
+#endif
+    return 0;
+}
+
+/// @return The filter if it's expected to skip enough vectors of the instruction set in
+///    use to pay for itself. Otherwise no filter.
+template <typename T>
+Byte_Filter vector_filter(Byte_Filter const& filter)
+{
+    // The most offsets in a vector that may pass on average. The exact test of a floating
+    // point number costs more, so skipping pays off sooner.
+    auto const max_passed = std::is_floating_point_v<T> ? 0.5 : 0.125;
+    auto const width = isa == Isa::avx512 ? 64 : isa == Isa::avx2 ? 32 : 16;
+    return filter.passed * width <= max_passed ? filter : Byte_Filter{};
+}
+
+/// Run the tests on the numbers in the data. See Range_Test.
+template <typename T, bool Native, bool Swapped>
+void match_ranges(std::byte const* data, std::size_t count, Range_Test<T> const& native,
+                  Range_Test<T> const& swapped, Stride const& stride)
+{
+    assert(std::has_single_bit(stride.align) && stride.phase < stride.align);
+    auto const words = (count + 63) / 64;
+    if constexpr (Native)
+        std::fill(native.mask, native.mask + words, 0);
+    if constexpr (Swapped)
+        std::fill(swapped.mask, swapped.mask + words, 0);
+    std::size_t done = 0;
+    // Vectors don't pay when there are few offsets to test.
+    if (stride.align < 64)
+    {
+        // Only the loads that hold aligned offsets are needed.
+        auto const step = std::min(stride.align, sizeof(T));
+        auto const first = stride.phase % step;
+        switch (sizeof(T) / step)
+        {
+        case 1:
+            done = match_vectors<T, Native, Swapped, 1>(data, count, native, swapped, first);
+            break;
+        case 2:
+            done = match_vectors<T, Native, Swapped, 2>(data, count, native, swapped, first);
+            break;
+        case 4:
+            if constexpr (sizeof(T) >= 4)
+                done = match_vectors<T, Native, Swapped, 4>(data, count, native, swapped,
+                                                            first);
+            break;
+        case 8:
+            if constexpr (sizeof(T) >= 8)
+                done = match_vectors<T, Native, Swapped, 8>(data, count, native, swapped,
+                                                            first);
+            break;
+        }
+        // Drop the offsets in the loaded lanes that aren't aligned.
+        if (stride.align > step)
+        {
+            std::uint64_t aligned = 0;
+            for (auto b = stride.phase; b < 64; b += stride.align)
+                aligned |= std::uint64_t(1) << b;
+            for (std::size_t w = 0; w < (done + 63) / 64; ++w)
+            {
+                if constexpr (Native)
+                    native.mask[w] &= aligned;
+                if constexpr (Swapped)
+                    swapped.mask[w] &= aligned;
+            }
+        }
+    }
+    if constexpr (Native)
+        match_range_scalar(data, done, count, native, false, stride);
+    if constexpr (Swapped)
+        match_range_scalar(data, done, count, swapped, true, stride);
+}
+
+template <typename T>
+void match_range(std::byte const* data, std::size_t count, T low, T high,
+                 std::uint64_t* mask, bool swap, Stride const& stride)
+{
+    match_range(data, count, low, high, T(0), mask, swap, stride);
+}
+
+template <typename T>
+void match_range(std::byte const* data, std::size_t count, T low, T high, T min,
+                 std::uint64_t* mask, bool swap, Stride const& stride)
+{
+    Range_Test<T> const test{low, high, min, mask,
+                             vector_filter<T>(byte_filter(low, high, min, swap))};
+    if (swap)
+        match_ranges<T, false, true>(data, count, test, test, stride);
+    else
+        match_ranges<T, true, false>(data, count, test, test, stride);
+}
+
+template <typename T>
+void match_range_both(std::byte const* data, std::size_t count, T low, T high,
+                      T swapped_low, T swapped_high, std::uint64_t* mask,
+                      std::uint64_t* swapped_mask, Stride const& stride)
+{
+    match_range_both(data, count, low, high, T(0), swapped_low, swapped_high, T(0), mask,
+                     swapped_mask, stride);
+}
+
+template <typename T>
+void match_range_both(std::byte const* data, std::size_t count, T low, T high, T min,
+                      T swapped_low, T swapped_high, T swapped_min, std::uint64_t* mask,
+                      std::uint64_t* swapped_mask, Stride const& stride)
+{
+    match_ranges<T, true, true>(data, count,
+                                {low, high, min, mask,
+                                 vector_filter<T>(byte_filter(low, high, min, false))},
+                                {swapped_low, swapped_high, swapped_min, swapped_mask,
+                                 vector_filter<T>(byte_filter(swapped_low, swapped_high,
+                                                           swapped_min, true))},
+                                stride);
+}
+
+template void match_range(std::byte const*, std::size_t, std::int16_t, std::int16_t,
+                          std::uint64_t*, bool, Stride const&);
+template void match_range(std::byte const*, std::size_t, std::int32_t, std::int32_t,
+                          std::uint64_t*, bool, Stride const&);
+template void match_range(std::byte const*, std::size_t, std::int64_t, std::int64_t,
+                          std::uint64_t*, bool, Stride const&);
+template void match_range_both(std::byte const*, std::size_t, std::int16_t, std::int16_t,
+                               std::int16_t, std::int16_t, std::uint64_t*, std::uint64_t*,
+                               Stride const&);
+template void match_range_both(std::byte const*, std::size_t, std::int32_t, std::int32_t,
+                               std::int32_t, std::int32_t, std::uint64_t*, std::uint64_t*,
+                               Stride const&);
+template void match_range_both(std::byte const*, std::size_t, std::int64_t, std::int64_t,
+                               std::int64_t, std::int64_t, std::uint64_t*, std::uint64_t*,
+                               Stride const&);
+
+template void match_range(std::byte const*, std::size_t, float, float, float,
+                          std::uint64_t*, bool, Stride const&);
+template void match_range(std::byte const*, std::size_t, double, double, double,
+                          std::uint64_t*, bool, Stride const&);
+template void match_range_both(std::byte const*, std::size_t, float, float, float, float,
+                               float, float, std::uint64_t*, std::uint64_t*,
+                               Stride const&);
+template void match_range_both(std::byte const*, std::size_t, double, double, double,
+                               double, double, double, std::uint64_t*, std::uint64_t*,
+                               Stride const&);
+
+Charset::Charset(std::array<bool, 256> const& printable)
+    : Charset({printable})
+{}
+
+Charset::Charset(std::initializer_list<std::array<bool, 256>> printable)
+    : m_printable(printable),
+      m_bits(printable.size())
+{
+    assert(m_printable.size() <= max_size);
+    // Give each distinct set of printable low nibbles in each charset its own bit in the
+    // high-nibble table. Set that bit in the low-nibble table for each nibble in the set.
+    // Bit 7 is reserved for terminators.
+    std::size_t n_bits = 0;
+    for (std::size_t s = 0; s < m_printable.size(); ++s)
+    {
+        std::array<std::uint16_t, 7> sets{};
+        std::size_t const first = n_bits;
+        for (std::size_t h = 0; h < 16; ++h)
+        {
+            std::uint16_t set = 0;
+            for (std::size_t l = 0; l < 16; ++l)
+                set |= m_printable[s][16*h + l] << l;
+            if (set == 0)
+                continue;
+            auto bit = std::find(sets.begin() + first, sets.begin() + n_bits, set)
+                - sets.begin();
+            if (bit == static_cast<std::ptrdiff_t>(n_bits))
+            {
+                if (n_bits == sets.size())
+                {
+                    m_has_nibble_tables = false;
+                    return;
+                }
+                sets[n_bits++] = set;
+            }
+            m_bits[s] |= 1 << bit;
+            m_hi[h] |= 1 << bit;
+            for (std::size_t l = 0; l < 16; ++l)
+                if (set >> l & 1)
+                    m_lo[l] |= 1 << bit;
+        }
+    }
+    for (int c = 0; c < 16; ++c)
+        if (is_terminator(c))
+            m_lo[c] |= 0x80;
+    m_hi[0] |= 0x80;
+}
+
+void classify(std::byte const* data, std::size_t count, Charset const& charset,
+              std::uint64_t* const* printable, std::uint64_t* terminator,
+              std::uint64_t* zero)
+{
+    std::size_t done = 0;
+#ifdef INSPECT_X86
+    if (charset.has_nibble_tables())
+    {
+        switch (isa)
+        {
+        case Isa::avx512:
+            done = classify_avx512(data, count, charset, printable, terminator, zero);
+            break;
+        case Isa::avx2:
+            done = classify_avx2(data, count, charset, printable, terminator, zero);
+            break;
+        case Isa::sse4_2:
+            done = classify_sse4_2(data, count, charset, printable, terminator, zero);
+            break;
+        case Isa::scalar:
+            break;
+        }
+    }
+#endif
+    auto const words = (count + 63) / 64;
+    for (std::size_t set = 0; set < charset.size(); ++set)
+        std::fill(printable[set] + done / 64, printable[set] + words, 0);
+    std::fill(terminator + done / 64, terminator + words, 0);
+    std::fill(zero + done / 64, zero + words, 0);
+    for (auto i = done; i < count; ++i)
+    {
+        auto c = std::to_integer<unsigned char>(data[i]);
+        auto const bit = std::uint64_t(1) << (i % 64);
+        for (std::size_t set = 0; set < charset.size(); ++set)
+            if (charset.printable(c, set))
+                printable[set][i / 64] |= bit;
+        if (is_terminator(c))
+            terminator[i / 64] |= bit;
+        if (c == 0)
+            zero[i / 64] |= bit;
+    }
+}
+
+std::size_t mask_offsets(std::uint64_t const* mask, std::size_t count,
+                         std::uint32_t* offsets)
+{
+#ifdef INSPECT_X86
+    if (isa == Isa::avx512)
+        return mask_offsets_avx512(mask, count, offsets);
+#endif
+    auto out = offsets;
+    for (std::size_t word = 0; word < (count + 63) / 64; ++word)
+        for (auto bits = mask[word]; bits != 0; bits &= bits - 1)
+            *out++ = 64*word + std::countr_zero(bits);
+    return out - offsets;
+}
@@ -0,0 +1,189 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INSPECT_INSPECT_BINARY_KERNELS_HH_INCLUDED
+#define INSPECT_INSPECT_BINARY_KERNELS_HH_INCLUDED
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+#include <vector>
+
+// Functions that test many consecutive byte offsets at once. Results are bitmaps with
+// bit i of mask[i / 64] (counting from the LSB) set if offset i matches.
+
+/// Instruction sets that kernels are written for, from least to most capable.
+enum class Isa
+{
+    scalar,
+    sse4_2,
+    avx2,
+    avx512, ///< AVX-512 F and BW with BMI2
+};
+
+/// @return The most capable instruction set supported by the CPU.
+Isa supported_isa();
+/// Use the given instruction set for kernels, or the most capable supported one if the
+/// CPU doesn't support it. Not safe to call while kernels are running.
+/// @return The instruction set that will be used.
+Isa use_isa(Isa isa);
+
+/// The offsets that are tested: the ones that are 'phase' more than a multiple of
+/// 'align'. 'align' must be a power of 2 and 'phase' must be less than it.
+struct Stride
+{
+    std::size_t align = 1;
+    std::size_t phase = 0;
+};
+
+/// Find the integers of type T that are in [low, high].
+/// @param data There must be count + sizeof(T) - 1 bytes readable from here.
+/// @param count The number of offsets to test.
+/// @param mask Set to the matching offsets. Must have room for count bits.
+/// @param swap If true, the numbers are in the other byte order. Their bytes are reversed
+///    before they're tested.
+/// @param stride The offsets to test, counted from 'data'. The others aren't set in
+///    'mask'. Fewer loads are done when 'align' is a multiple of sizeof(T).
+template <typename T>
+void match_range(std::byte const* data, std::size_t count, T low, T high,
+                 std::uint64_t* mask, bool swap = false, Stride const& stride = {});
+
+/// Find the floating point numbers of type T that are in [low, high] and aren't within
+/// 'min' of zero unless they're exactly zero. NaNs never match. -0 is exactly zero.
+/// Parameters are as for the integer version.
+template <typename T>
+void match_range(std::byte const* data, std::size_t count, T low, T high, T min,
+                 std::uint64_t* mask, bool swap = false, Stride const& stride = {});
+
+/// Find the integers of type T that are in [low, high] in the native byte order, and the
+/// ones in [swapped_low, swapped_high] in the other byte order. Each vector of data is
+/// loaded once and tested both ways, so this is cheaper than two calls to match_range().
+/// Parameters are as for match_range().
+template <typename T>
+void match_range_both(std::byte const* data, std::size_t count, T low, T high,
+                      T swapped_low, T swapped_high, std::uint64_t* mask,
+                      std::uint64_t* swapped_mask, Stride const& stride = {});
+
+/// The floating point version of match_range_both().
+template <typename T>
+void match_range_both(std::byte const* data, std::size_t count, T low, T high, T min,
+                      T swapped_low, T swapped_high, T swapped_min, std::uint64_t* mask,
+                      std::uint64_t* swapped_mask, Stride const& stride = {});
+
+/// List the offsets of the bits set in a mask from match_range(), in order. Bits for
+/// offsets at or after 'count' must be clear.
+/// @param offsets Must have room for an offset for each bit that's set.
+/// @return The number of offsets listed.
+std::size_t mask_offsets(std::uint64_t const* mask, std::size_t count,
+                         std::uint32_t* offsets);
+
+/// @return The value with its bytes in the reverse order.
+template <typename T>
+T byte_swap(T value)
+{
+    std::array<std::byte, sizeof(T)> bytes;
+    std::memcpy(bytes.data(), &value, sizeof value);
+    std::reverse(bytes.begin(), bytes.end());
+    std::memcpy(&value, bytes.data(), sizeof value);
+    return value;
+}
+
+/// @return A table indexed by byte that marks the bytes in the given inclusive ranges.
+constexpr std::array<bool, 256> byte_table(std::initializer_list<std::array<int, 2>> ranges)
+{
+    std::array<bool, 256> out{};
+    for (auto [first, last] : ranges)
+        for (auto c = first; c <= last; ++c)
+            out[c] = true;
+    return out;
+}
+
+// Character sets for strings. They don't depend on the locale, so strings in different
+// sets can be searched for at the same time.
+
+/// The printable ASCII characters, as given by isprint() in the C locale.
+struct Ascii
+{
+    static constexpr auto printable = byte_table({{0x20, 0x7e}});
+};
+
+/// The printable Latin-1 (ISO 8859-1) characters, as given by isprint() in the
+/// en_US.iso88591 locale: printable ASCII, no-break space, and 0xa1 to 0xff.
+struct Latin_1
+{
+    static constexpr auto printable = byte_table({{0x20, 0x7e}, {0xa0, 0xff}});
+};
+
+/// Sets of printable characters. Holds a table indexed by byte for each set and a pair of
+/// tables indexed by nibble for classifying 16 bytes at a time with shuffles. Each set has
+/// its own class bits in the nibble tables, so the bytes are classified for all the sets
+/// at once.
+class Charset
+{
+public:
+    Charset(std::array<bool, 256> const& printable);
+    /// @param printable A table for each set. There may be at most max_size.
+    Charset(std::initializer_list<std::array<bool, 256>> printable);
+
+    /// The most sets a charset can hold. Each needs at least one of the class bits that
+    /// aren't used for terminators.
+    static std::size_t constexpr max_size = 7;
+
+    /// @return The number of sets.
+    std::size_t size() const { return m_printable.size(); }
+    /// @return True if the byte is printable in the given set.
+    bool printable(unsigned char c, std::size_t set = 0) const
+    {
+        return m_printable[set][c];
+    }
+    /// @return The class bits of low nibbles. A byte b is printable in set s if
+    ///    lo[b & 0xf] & hi[b >> 4] & bits(s) is nonzero, and a string terminator (\0 \t
+    ///    \n \r) if bit 7 is set.
+    std::array<std::uint8_t, 16> const& lo() const { return m_lo; }
+    /// @return The class bits of high nibbles.
+    std::array<std::uint8_t, 16> const& hi() const { return m_hi; }
+    /// @return The class bits of the given set.
+    std::uint8_t bits(std::size_t set) const { return m_bits[set]; }
+    /// @return False if the printable sets can't be represented by nibble tables. Only
+    ///    the scalar kernel is used in that case.
+    bool has_nibble_tables() const { return m_has_nibble_tables; }
+
+private:
+    std::vector<std::array<bool, 256>> m_printable;
+    std::vector<std::uint8_t> m_bits;
+    std::array<std::uint8_t, 16> m_lo{};
+    std::array<std::uint8_t, 16> m_hi{};
+    bool m_has_nibble_tables = true;
+};
+
+/// @return True if the byte ends a string.
+inline bool is_terminator(unsigned char c)
+{
+    return c == '\0' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/// Classify bytes as printable in each set of the charset, string terminators, and zero.
+/// @param count The number of bytes to classify.
+/// @param printable Element s is set to the bytes that are printable in set s.
+/// @param terminator, zero Set to the bytes in each class. Each bitmap must have room for
+///    count bits.
+void classify(std::byte const* data, std::size_t count, Charset const& charset,
+              std::uint64_t* const* printable, std::uint64_t* terminator,
+              std::uint64_t* zero);
+
+#endif // INSPECT_INSPECT_BINARY_KERNELS_HH_INCLUDED
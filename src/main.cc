@@ -14,22 +14,41 @@
 // If not, see <http://www.gnu.org/licenses/>.
 
 #include "inspect.hh"
+#include "mapped_file.hh"
+#include "output.hh"
 
 #define TEST
 #define DOCTEST_CONFIG_IMPLEMENT
+// Only take test options with the --dt- prefix so that they don't collide with ours,
+// e.g. -c and --count.
+#define DOCTEST_CONFIG_NO_UNPREFIXED_OPTIONS
 #include "../test/doctest.h"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cctype>
+#include <cerrno>
+#include <charconv>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <getopt.h>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
 #include <numeric>
+#include <optional>
 #include <span>
 #include <sstream>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
+#include <unistd.h>
+
 /// Exception raised when the range isn't in the expected format.
 struct bad_format : public std::runtime_error
 {
@@ -38,6 +57,50 @@ struct bad_format : public std::runtime_error
     {}
 };
 
+/// Exception raised when the number of jobs isn't a positive integer.
+struct bad_jobs : public std::runtime_error
+{
+    bad_jobs(std::string const& arg)
+        : runtime_error{"Number of jobs should be a positive integer (" + arg + ")"}
+    {}
+};
+
+/// Exception raised when the maximum count isn't a positive integer.
+struct bad_count : public std::runtime_error
+{
+    bad_count(std::string const& arg)
+        : runtime_error{"Maximum count should be a positive integer (" + arg + ")"}
+    {}
+};
+
+/// Exception raised when the histogram bucket size isn't valid.
+struct bad_bucket : public std::runtime_error
+{
+    bad_bucket(std::string const& arg)
+        : runtime_error{"Bucket size should be at least 16 bytes, optionally with a K, M "
+                        "or G suffix (" + arg + ")"}
+    {}
+};
+
+/// Exception raised when an offset, length or region isn't valid.
+struct bad_region : public std::runtime_error
+{
+    bad_region(std::string const& arg)
+        : runtime_error{"Offsets and lengths should be non-negative integers, optionally in "
+                        "hex with 0x or with a K, M or G suffix. Regions should be "
+                        "<start>:[<end>] with <start> before <end> (" + arg + ")"}
+    {}
+};
+
+/// Exception raised when an alignment isn't valid.
+struct bad_align : public std::runtime_error
+{
+    bad_align(std::string const& arg)
+        : runtime_error{"Alignment should be a power of 2, optionally followed by +<phase> "
+                        "with <phase> less than it. Strings can't be aligned (" + arg + ")"}
+    {}
+};
+
 /// Exception raised when a file name isn't given.
 struct missing_file : public std::runtime_error
 {
@@ -53,6 +116,11 @@ std::map<std::string, Range> const default_ranges = {
     {"i64", {"-1000", "1000"}}, // value
     {"i32", {"-1000", "1000"}},
     {"i16", {"-1000", "1000"}},
+    {"f64be", {"-1e6", "1e6", "1e-6"}},
+    {"f32be", {"-1e6", "1e6", "1e-6"}},
+    {"i64be", {"-1000", "1000"}},
+    {"i32be", {"-1000", "1000"}},
+    {"i16be", {"-1000", "1000"}},
     {"s16", {"3", "64"}}, // string length
     {"s8",  {"3", "64"}},
     {"a16", {"3", "64"}},
@@ -82,6 +150,187 @@ Range get_range(std::string const& str)
     return {low, high, min};
 };
 
+/// @return The positive integer in the string, or 0 if it isn't one.
+template <typename T>
+T get_positive(std::string const& str)
+{
+    std::istringstream is(str);
+    T value = 0;
+    char extra;
+    if (str.empty() || !std::isdigit(str.front()) || !(is >> value) || is >> extra)
+        return 0;
+    return value;
+}
+
+/// Parse the number of jobs and return it or throw.
+unsigned get_jobs(std::string const& str)
+{
+    auto jobs = get_positive<unsigned>(str);
+    if (jobs == 0)
+        throw bad_jobs(str);
+    return jobs;
+}
+
+/// Parse the maximum number of lines to show and return it or throw.
+std::size_t get_count(std::string const& str)
+{
+    auto count = get_positive<std::size_t>(str);
+    if (count == 0)
+        throw bad_count(str);
+    return count;
+}
+
+/// @return The non-negative number of bytes in the string, or nothing if it isn't one.
+///    The number may be in hex with a 0x prefix, and may have a binary K, M or G suffix.
+std::optional<std::streamoff> get_size(std::string const& str)
+{
+    std::streamoff scale = 1;
+    auto number = str;
+    if (!number.empty())
+    {
+        auto const suffix = std::toupper(static_cast<unsigned char>(number.back()));
+        std::string const suffixes = "KMG";
+        if (auto i = suffixes.find(suffix); i != std::string::npos)
+        {
+            scale = std::streamoff(1) << 10*(i + 1);
+            number.pop_back();
+        }
+    }
+    int base = 10;
+    if (number.starts_with("0x") || number.starts_with("0X"))
+    {
+        base = 16;
+        number.erase(0, 2);
+    }
+    std::streamoff size = 0;
+    auto const end = number.data() + number.size();
+    if (number.empty() || !std::isxdigit(static_cast<unsigned char>(number.front())))
+        return std::nullopt;
+    if (auto [ptr, error] = std::from_chars(number.data(), end, size, base);
+        error != std::errc() || ptr != end
+        || size > std::numeric_limits<std::streamoff>::max() / scale)
+        return std::nullopt;
+    return size*scale;
+}
+
+/// Parse the size of histogram buckets and return it or throw.
+std::streamoff get_bucket(std::string const& str)
+{
+    auto size = get_size(str);
+    if (!size || *size < 16)
+        throw bad_bucket(str);
+    return *size;
+}
+
+/// Parse an alignment given as <align>[+<phase>] and return the alignment and phase or
+/// throw.
+std::pair<std::size_t, std::size_t> get_align(std::string const& str)
+{
+    auto const plus = str.find('+');
+    auto const align = get_size(str.substr(0, plus));
+    auto const phase = plus == std::string::npos ? std::optional<std::streamoff>(0)
+                                                 : get_size(str.substr(plus + 1));
+    if (!align || !phase || !std::has_single_bit(static_cast<std::uint64_t>(*align))
+        || *phase >= *align)
+        throw bad_align(str);
+    return {*align, *phase};
+}
+
+/// A range of bytes in the file.
+struct Region
+{
+    std::streamoff offset = 0;
+    /// The number of bytes. The region is cut short at the end of the file.
+    std::streamoff length = std::numeric_limits<std::streamoff>::max();
+
+    bool operator==(Region const&) const = default;
+};
+
+/// Parse an offset or length and return it or throw.
+std::streamoff get_offset(std::string const& str)
+{
+    auto offset = get_size(str);
+    if (!offset)
+        throw bad_region(str);
+    return *offset;
+}
+
+/// Parse a region given as <start>:[<end>] and return it or throw. The end is exclusive.
+/// With no end, the region goes to the end of the file.
+Region get_region(std::string const& str)
+{
+    auto const colon = str.find(':');
+    if (colon == std::string::npos)
+        throw bad_region(str);
+    auto const start = get_size(str.substr(0, colon));
+    if (!start)
+        throw bad_region(str);
+    if (colon + 1 == str.size())
+        return {*start};
+    auto const end = get_size(str.substr(colon + 1));
+    if (!end || *end <= *start)
+        throw bad_region(str);
+    return {*start, *end - *start};
+}
+
+/// @return The regions in order with overlapping and adjacent ones joined.
+std::vector<Region> join_regions(std::vector<Region> regions)
+{
+    auto const max = std::numeric_limits<std::streamoff>::max();
+    auto const end = [max](Region const& region) {
+        return region.length > max - region.offset ? max : region.offset + region.length;
+    };
+    std::sort(regions.begin(), regions.end(), [](auto const& r1, auto const& r2) {
+        return r1.offset < r2.offset;
+    });
+    std::vector<Region> out;
+    for (auto const& region : regions)
+    {
+        if (!out.empty() && region.offset <= end(out.back()))
+        {
+            auto const last = std::max(end(out.back()), end(region));
+            out.back().length = last == max ? max : last - out.back().offset;
+        }
+        else
+            out.push_back(region);
+    }
+    return out;
+}
+
+/// How the matches are shown.
+struct Output
+{
+    /// Show the number of matches of each type instead of the matches.
+    bool count = false;
+    /// Stop after this many lines of the report. 0 means no limit.
+    std::size_t max_count = 0;
+    /// Don't show anything. Exit with status 0 at the first match, or 1 if there isn't
+    /// one.
+    bool quiet = false;
+};
+
+/// @return The filters with a filter for the other byte order added after each number
+///    filter that doesn't have one. The added filters have the same ranges.
+Spec add_other_byte_orders(Spec const& spec)
+{
+    Spec out;
+    for (auto const& filter : spec)
+    {
+        out.push_back(filter);
+        auto const type = to_type(filter.type);
+        if (is_string(type))
+            continue;
+        auto const other = to_string(other_byte_order(type));
+        if (std::none_of(spec.begin(), spec.end(),
+                         [&other](auto const& f) { return f.type == other; }))
+        {
+            out.push_back(filter);
+            out.back().type = other;
+        }
+    }
+    return out;
+}
+
 /// @return The string representation of a collection of range filters.
 std::string to_string(Spec const& spec)
 {
@@ -91,6 +340,10 @@ std::string to_string(Spec const& spec)
            << p2.range.low << ':' << p2.range.high;
         if (p2.range.min != "0")
             os << ':' << p2.range.min;
+        if (p2.align != 1)
+            os << '@' << p2.align;
+        if (p2.phase != 0)
+            os << '+' << p2.phase;
         os << ' ';
         return os.str();
     };
@@ -106,37 +359,102 @@ std::string const usage =
     "  -l --i64=[range] show 64-bit integers.\n"
     "  -i --i32=[range] show 32-bit integers.\n"
     "  -s --i16=[range] show 16-bit integers.\n"
+    "  -D --f64be=[range], -F --f32be=[range], -L --i64be=[range], -I --i32be=[range],\n"
+    "  -S --i16be=[range]\n"
+    "                   show big-endian numbers.\n"
+    "  -e --both-endians\n"
+    "                   look for each number in both byte orders. Each vector of data\n"
+    "                   is loaded once for both.\n"
+    "  -g --align=N[+P] only look for numbers at offsets that are P more than a\n"
+    "                   multiple of N. Applies to number filters without their own\n"
+    "                   alignment.\n"
     "  -Z --s16=[range] show 2-byte Latin-1 strings.\n"
     "  -z --s8=[range]  show 1-byte Latin-1 strings.\n"
     "  -A --s16=[range] show 2-byte ASCII strings.\n"
     "  -a --s8=[range]  show 1-byte ASCII strings.\n"
+    "  -j --jobs=N      scan with N threads. The default is one per available CPU.\n"
+    "  -m --max-count=N stop after N lines of output.\n"
+    "  -q --quiet       show nothing. Exit with status 0 at the first match, or 1 if\n"
+    "                   there's none.\n"
+    "  -c --count       show the number of matches of each type.\n"
+    "  -b --histogram=N show the number of matches of each type in each N bytes.\n"
+    "                   N may have a K, M or G suffix.\n"
+    "  -o --offset=N    start reading N bytes into the file.\n"
+    "  -n --length=N    read at most N bytes.\n"
+    "  -r --region=A:B  read from A up to B, or to the end of the file if B is\n"
+    "                   left out. May be given more than once.\n"
     "\n"
     "Range is given as <low>:<high>[:<min>]. For strings, <low> and <high> are lengths.\n"
+    "A string length above 4294967295 is taken as 4294967295.\n"
+    "A number filter may be aligned with @N[+P] after the range, or in place of it to\n"
+    "use the default range. N is a power of 2 and P is less than N.\n"
+    "Offsets and lengths may be in hex with 0x, and may have a K, M or G suffix.\n"
+    "Addresses in the output are from the start of the file.\n"
+    "Use - as the file to read standard input.\n"
     "\n"
     "With no options, the behavior is the same as\n"
     + to_string(default_spec)
     + '\n';
 
 /// Parse the command line.
-/// @return A pair of the name of the file to inspect and the range filters.
-std::pair<std::string, Spec> parse_args(int argc, char** argv)
+/// @return The name of the file to inspect, the range filters, the settings, how to
+///    show the matches, and the regions of the file to read in order. No regions means
+///    the whole file.
+std::tuple<std::string, Spec, Settings, Output, std::vector<Region>>
+parse_args(int argc, char** argv)
 {
     Spec spec;
+    Settings settings;
+    Output output;
+    std::vector<Region> regions;
+    std::optional<Region> range;
+    bool both_endians = false;
+    std::optional<std::pair<std::size_t, std::size_t>> align;
+    // The indexes of the number filters that weren't given an alignment.
+    std::vector<std::size_t> unaligned;
     option options[] = {
         {"f64", optional_argument, nullptr, 'd'},
         {"f32", optional_argument, nullptr, 'f'},
         {"i64", optional_argument, nullptr, 'l'},
         {"i32", optional_argument, nullptr, 'i'},
         {"i16", optional_argument, nullptr, 's'},
+        {"f64be", optional_argument, nullptr, 'D'},
+        {"f32be", optional_argument, nullptr, 'F'},
+        {"i64be", optional_argument, nullptr, 'L'},
+        {"i32be", optional_argument, nullptr, 'I'},
+        {"i16be", optional_argument, nullptr, 'S'},
+        {"both-endians", no_argument, nullptr, 'e'},
+        {"align", required_argument, nullptr, 'g'},
         {"s16", optional_argument, nullptr, 'Z'},
         {"s8", optional_argument, nullptr, 'z'},
         {"a16", optional_argument, nullptr, 'A'},
         {"a8", optional_argument, nullptr, 'a'},
+        {"jobs", required_argument, nullptr, 'j'},
+        {"max-count", required_argument, nullptr, 'm'},
+        {"quiet", no_argument, nullptr, 'q'},
+        {"count", no_argument, nullptr, 'c'},
+        {"histogram", required_argument, nullptr, 'b'},
+        {"offset", required_argument, nullptr, 'o'},
+        {"length", required_argument, nullptr, 'n'},
+        {"region", required_argument, nullptr, 'r'},
         {"help", no_argument, nullptr, 'h'},
         {0, 0, 0, 0}};
 
     auto add_filter = [&](std::string const& opt) {
-        spec.emplace_back(opt, ::optarg ? get_range(::optarg) : default_ranges.at(opt));
+        std::string const arg = ::optarg ? ::optarg : "";
+        auto const at = arg.find('@');
+        Filter filter{opt, ::optarg && at != 0 ? get_range(arg.substr(0, at))
+                                               : default_ranges.at(opt)};
+        auto const string = is_string(to_type(opt));
+        if (at != std::string::npos)
+        {
+            if (string)
+                throw bad_align(arg);
+            std::tie(filter.align, filter.phase) = get_align(arg.substr(at + 1));
+        }
+        else if (!string)
+            unaligned.push_back(spec.size());
+        spec.push_back(filter);
     };
 
     // getopt doesn't expect to be called multiple times, but it is if tests are
@@ -147,7 +465,10 @@ std::pair<std::string, Spec> parse_args(int argc, char** argv)
     while (true)
     {
         int index;
-        int c = getopt_long(argc, argv, "A::a::d::f::i::l::s::Z::z::", options, &index);
+        int c = getopt_long(argc, argv,
+                            "A::a::d::f::i::l::s::D::F::I::L::S::Z::z::"
+                            "eg:j:m:qcb:o:n:r:",
+                            options, &index);
         if (c == -1)
             break;
         switch (c)
@@ -167,6 +488,27 @@ std::pair<std::string, Spec> parse_args(int argc, char** argv)
         case 's':
             add_filter("i16");
             break;
+        case 'D':
+            add_filter("f64be");
+            break;
+        case 'F':
+            add_filter("f32be");
+            break;
+        case 'L':
+            add_filter("i64be");
+            break;
+        case 'I':
+            add_filter("i32be");
+            break;
+        case 'S':
+            add_filter("i16be");
+            break;
+        case 'e':
+            both_endians = true;
+            break;
+        case 'g':
+            align = get_align(::optarg);
+            break;
         case 'Z':
             add_filter("s16");
             break;
@@ -179,6 +521,35 @@ std::pair<std::string, Spec> parse_args(int argc, char** argv)
         case 'a':
             add_filter("a8");
             break;
+        case 'j':
+            settings.jobs = get_jobs(::optarg);
+            break;
+        case 'm':
+            output.max_count = get_count(::optarg);
+            break;
+        case 'q':
+            output.quiet = true;
+            break;
+        case 'c':
+            // Everything is in one bucket.
+            output.count = true;
+            settings.bucket = std::numeric_limits<std::streamoff>::max();
+            break;
+        case 'b':
+            output.count = false;
+            settings.bucket = get_bucket(::optarg);
+            break;
+        case 'o':
+            range = range.value_or(Region());
+            range->offset = get_offset(::optarg);
+            break;
+        case 'n':
+            range = range.value_or(Region());
+            range->length = get_offset(::optarg);
+            break;
+        case 'r':
+            regions.push_back(get_region(::optarg));
+            break;
         case 'h':
             std::cerr << usage;
             exit(0);
@@ -189,7 +560,160 @@ std::pair<std::string, Spec> parse_args(int argc, char** argv)
 
     if (::optind >= argc || !argv[::optind])
         throw(missing_file());
-    return {argv[::optind], spec.empty() ? default_spec : spec};
+    if (range)
+        regions.push_back(*range);
+    if (spec.empty())
+    {
+        spec = default_spec;
+        for (std::size_t i = 0; i < spec.size(); ++i)
+            if (!is_string(to_type(spec[i].type)))
+                unaligned.push_back(i);
+    }
+    if (align)
+        for (auto i : unaligned)
+            std::tie(spec[i].align, spec[i].phase) = *align;
+    if (both_endians)
+        spec = add_other_byte_orders(spec);
+    return {argv[::optind], spec, settings, output, join_regions(regions)};
+}
+
+/// A stream buffer that reads at most a given number of bytes from another one.
+class Limited_Buffer : public std::streambuf
+{
+public:
+    Limited_Buffer(std::streambuf& source, std::streamoff length)
+        : m_source(source),
+          m_remaining(length)
+    {}
+    /// @return The number of bytes read from the source.
+    std::streamoff count() const { return m_count; }
+
+protected:
+    int_type underflow() override
+    {
+        if (gptr() == egptr())
+        {
+            auto const n = m_source.sgetn(m_buffer.data(), std::min<std::streamoff>(
+                                              m_remaining, m_buffer.size()));
+            m_remaining -= n;
+            m_count += n;
+            setg(m_buffer.data(), m_buffer.data(), m_buffer.data() + n);
+        }
+        return gptr() == egptr() ? traits_type::eof() : traits_type::to_int_type(*gptr());
+    }
+    std::streamsize xsgetn(char* s, std::streamsize count) override
+    {
+        // Whole windows are read, so skip the buffer.
+        auto const buffered = std::min<std::streamsize>(count, egptr() - gptr());
+        std::copy(gptr(), gptr() + buffered, s);
+        gbump(buffered);
+        auto const n = m_source.sgetn(
+            s + buffered, std::min<std::streamoff>(m_remaining, count - buffered));
+        m_remaining -= n;
+        m_count += n;
+        return buffered + n;
+    }
+
+private:
+    std::streambuf& m_source;
+    std::streamoff m_remaining;
+    std::streamoff m_count = 0;
+    std::array<char, 4096> m_buffer;
+};
+
+/// Send the matches in each region to 'sink'. A row or bucket may span regions, so its
+/// matches are held back until the next region has been scanned.
+/// @param scan Called with each region and the settings and sink to scan it with.
+///    Returns false if the data ended before the end of the region.
+template <typename Scan>
+void scan_regions(std::vector<Region> const& regions, Settings settings,
+                  Report_Sink const& sink, Scan scan)
+{
+    auto const max = std::numeric_limits<std::streamoff>::max();
+    Report held(settings.bucket);
+    bool more = true;
+    auto const pass = [&](std::streamoff before) {
+        auto rows = held.take_rows_before(before);
+        if (!rows.empty())
+            more = sink(rows);
+        return more;
+    };
+    for (size_t i = 0; i < regions.size() && more; ++i)
+    {
+        auto const before = i + 1 < regions.size() ? regions[i + 1].offset : max;
+        settings.origin = regions[i].offset;
+        bool const rest = scan(regions[i], settings, [&](Report const& report) {
+            if (held.empty() && before == max)
+                return more = sink(report);
+            held.merge(report);
+            return pass(before);
+        });
+        if (!rest)
+            break;
+    }
+    if (more)
+        pass(max);
+}
+
+/// Send the matches in the regions of a stream to 'sink'.
+void inspect_regions(std::istream& is, Spec const& spec, Settings const& settings,
+                     std::vector<Region> const& regions, Report_Sink const& sink)
+{
+    auto& source = *is.rdbuf();
+    std::streamoff position = 0;
+    scan_regions(regions, settings, sink, [&](Region const& region,
+                                              Settings const& settings,
+                                              Report_Sink const& sink) {
+        // Seek if the stream can, otherwise read up to the region.
+        auto skip = region.offset - position;
+        if (skip > 0 && source.pubseekoff(skip, std::ios::cur, std::ios::in) == -1)
+        {
+            std::array<char, 4096> discard;
+            while (skip > 0)
+            {
+                auto const n = source.sgetn(
+                    discard.data(), std::min<std::streamoff>(skip, discard.size()));
+                if (n == 0)
+                    return false;
+                skip -= n;
+            }
+        }
+        Limited_Buffer buffer(source, region.length);
+        std::istream part(&buffer);
+        inspect(part, spec, settings, sink);
+        position = region.offset + buffer.count();
+        return buffer.count() == region.length;
+    });
+}
+
+/// Send the matches in the named file to 'sink' as they're found. Regular files are
+/// mapped into memory one region at a time. Standard input ("-"), pipes and devices are
+/// read one window at a time.
+/// @param regions The parts of the file to read, in order. No regions means the whole
+///    file.
+void inspect_file(std::string const& file, Spec const& spec, Settings const& settings,
+                  std::vector<Region> regions, Report_Sink const& sink)
+{
+    if (regions.empty())
+        regions.push_back({});
+    if (file == "-")
+        return inspect_regions(std::cin, spec, settings, regions, sink);
+    std::error_code error;
+    if (std::filesystem::is_regular_file(file, error))
+    {
+        return scan_regions(regions, settings, sink, [&](Region const& region,
+                                                         Settings const& settings,
+                                                         Report_Sink const& sink) {
+            // Only the region is mapped, so only it is read.
+            Mapped_File input(file, region.offset, region.length);
+            inspect(input.data(), spec, settings, sink);
+            return true;
+        });
+    }
+    std::ifstream is(file, std::ios::binary);
+    if (!is)
+        throw bad_file(file, std::strerror(errno));
+    inspect_regions(is, spec, settings, regions, sink);
 }
 
 // Entry point
@@ -206,15 +730,61 @@ int main(int argc, char** argv)
 
     try
     {
-        auto [file, spec] = parse_args(argc, argv);
-        auto is = std::ifstream(file);
-        for (auto const& line : format_report(inspect(is, spec)))
-            std::cout << line << std::endl;
+        auto [file, spec, settings, output, regions] = parse_args(argc, argv);
+        Fd_Writer out(STDOUT_FILENO);
+        std::size_t lines = 0;
+        auto const write_line = [&](std::string_view line) {
+            if (output.max_count > 0 && lines == output.max_count)
+                return;
+            ++lines;
+            out.write(line);
+            out.write("\n");
+        };
+        bool found = false;
+        // The types in the order they're counted.
+        std::vector<Type> columns;
+        for (auto const& filter : spec)
+            columns.push_back(to_type(filter.type));
+        std::sort(columns.begin(), columns.end());
+        columns.erase(std::unique(columns.begin(), columns.end()), columns.end());
+        std::vector<std::uint64_t> totals(columns.size());
+        if (settings.bucket > 0 && !output.count && !output.quiet)
+            write_line(histogram_header(columns));
+        // Show the matches as soon as they're final.
+        inspect_file(file, spec, settings, regions, [&](Report const& report) {
+            found = true;
+            if (output.quiet)
+                return false;
+            if (output.count)
+            {
+                for (auto const& entry : report)
+                    totals[std::find(columns.begin(), columns.end(), entry.type)
+                           - columns.begin()] += entry.bits;
+                return true;
+            }
+            if (settings.bucket > 0)
+                format_histogram(report, columns, write_line);
+            else
+                format_report(report, write_line);
+            out.flush();
+            return output.max_count == 0 || lines < output.max_count;
+        });
+        if (output.count)
+            for (size_t i = 0; i < columns.size(); ++i)
+            {
+                auto const name = to_string(columns[i]);
+                write_line(name + std::string(std::max<size_t>(name.size() + 1, 4)
+                                              - name.size(), ' ')
+                           + std::to_string(totals[i]));
+            }
+        if (!found && output.quiet)
+            return EXIT_FAILURE;
     }
     catch(std::runtime_error const& e)
     {
         std::cerr << "Error: " << e.what() << "\n\n" << usage;
-        return EXIT_FAILURE;
+        // Distinct from -q finding nothing.
+        return 2;
     }
     return EXIT_SUCCESS;
 }
@@ -254,6 +824,8 @@ TEST_CASE("spec to string")
 {
     CHECK(to_string(Spec()) == "");
     CHECK(to_string(default_spec) == "--f64=-1e6:1e6:1e-6 --i32=-1000:1000 --s8=3:64 ");
+    CHECK(to_string({{"i64", {"-1", "1"}, 8}, {"i16", {"-1", "1"}, 4, 2}})
+          == "--i64=-1:1@8 --i16=-1:1@4+2 ");
 }
 
 bool operator==(Range const& r1, Range const& r2) noexcept
@@ -263,7 +835,19 @@ bool operator==(Range const& r1, Range const& r2) noexcept
 
 bool operator==(Filter const& f1, Filter const& f2) noexcept
 {
-    return f1.type == f2.type && f1.range == f2.range;
+    return f1.type == f2.type && f1.range == f2.range && f1.align == f2.align
+        && f1.phase == f2.phase;
+}
+
+bool operator==(Settings const& s1, Settings const& s2) noexcept
+{
+    return s1.engine == s2.engine && s1.jobs == s2.jobs && s1.bucket == s2.bucket
+        && s1.origin == s2.origin;
+}
+
+bool operator==(Output const& o1, Output const& o2) noexcept
+{
+    return o1.count == o2.count && o1.max_count == o2.max_count && o1.quiet == o2.quiet;
 }
 
 TEST_CASE("args")
@@ -280,8 +864,9 @@ TEST_CASE("args")
     };
 
     std::string file = "file";
-    auto result = [&file](Spec const& spec) {
-        return std::make_pair(file, spec);
+    auto result = [&file](Spec const& spec, Settings const& settings = {},
+                          Output const& output = {}, std::vector<Region> const& regions = {}) {
+        return std::make_tuple(file, spec, settings, output, regions);
     };
 
     CHECK_THROWS_AS(parse({}), missing_file);
@@ -314,5 +899,91 @@ TEST_CASE("args")
     CHECK(parse({file, "--s8=3:9"}) == result({{"s8", {"3","9"}}}));
     CHECK(parse({file, "--s8=-3:9"}) == result({{"s8", {"-3","9"}}}));
 
+    CHECK(parse({file, "-D"}) == result({{"f64be", default_ranges.at("f64be")}}));
+    CHECK(parse({file, "--f32be=-3:9"}) == result({{"f32be", {"-3", "9"}}}));
+    CHECK(parse({file, "-L-3:9"}) == result({{"i64be", {"-3", "9"}}}));
+    CHECK(parse({file, "--i32be"}) == result({{"i32be", default_ranges.at("i32be")}}));
+    CHECK(parse({file, "-S"}) == result({{"i16be", default_ranges.at("i16be")}}));
+    CHECK(parse({file, "-e"})
+          == result({{"f64", {"-1e6", "1e6", "1e-6"}}, {"f64be", {"-1e6", "1e6", "1e-6"}},
+                     {"i32", {"-1000", "1000"}}, {"i32be", {"-1000", "1000"}},
+                     {"s8", {"3", "64"}}}));
+    // A filter that's given for the other byte order isn't replaced.
+    CHECK(parse({file, "-I1:2", "--both-endians", "-i3:4", "-s"})
+          == result({{"i32be", {"1", "2"}}, {"i32", {"3", "4"}},
+                     {"i16", default_ranges.at("i16")},
+                     {"i16be", default_ranges.at("i16")}}));
+
+    CHECK(parse({file, "--i64=-3:9@8"}) == result({{"i64", {"-3", "9"}, 8}}));
+    CHECK(parse({file, "-i@4+2"}) == result({{"i32", default_ranges.at("i32"), 4, 2}}));
+    CHECK(parse({file, "--f32=-3:9:1e-3@0x10+0xc"})
+          == result({{"f32", {"-3", "9", "1e-3"}, 16, 12}}));
+    // --align applies to number filters without their own alignment.
+    CHECK(parse({file, "-l@2", "-i", "--align=4", "-z"})
+          == result({{"i64", default_ranges.at("i64"), 2}, {"i32", default_ranges.at("i32"), 4},
+                     {"s8", default_ranges.at("s8")}}));
+    CHECK(parse({file, "-g8+4"})
+          == result({{"f64", {"-1e6", "1e6", "1e-6"}, 8, 4}, {"i32", {"-1000", "1000"}, 8, 4},
+                     {"s8", {"3", "64"}}}));
+    CHECK(parse({file, "-s@2+1", "-e"})
+          == result({{"i16", default_ranges.at("i16"), 2, 1},
+                     {"i16be", default_ranges.at("i16"), 2, 1}}));
+    CHECK(parse({file, "-i@1"}) == result({{"i32", default_ranges.at("i32")}}));
+    CHECK_THROWS_AS(parse({file, "-i@3"}), bad_align);
+    CHECK_THROWS_AS(parse({file, "-i@4+4"}), bad_align);
+    CHECK_THROWS_AS(parse({file, "-i@0"}), bad_align);
+    CHECK_THROWS_AS(parse({file, "-i@"}), bad_align);
+    CHECK_THROWS_AS(parse({file, "-i@4+"}), bad_align);
+    CHECK_THROWS_AS(parse({file, "-z3:9@4"}), bad_align);
+    CHECK_THROWS_AS(parse({file, "--align=x"}), bad_align);
+
     CHECK_THROWS_AS(parse({file, "--i32=0-25"}), bad_format);
+    CHECK(std::get<0>(parse({"-", "-i"})) == "-");
+
+    CHECK(parse({file, "-j3"}) == result(default_spec, {Engine::fused, 3}));
+    CHECK(parse({file, "--jobs=12", "-i"})
+          == result({{"i32", default_ranges.at("i32")}}, {Engine::fused, 12}));
+    CHECK(parse({file, "--jobs", "1"}) == result(default_spec, {Engine::fused, 1}));
+    CHECK_THROWS_AS(parse({file, "--jobs=0"}), bad_jobs);
+    CHECK_THROWS_AS(parse({file, "--jobs=-2"}), bad_jobs);
+    CHECK_THROWS_AS(parse({file, "--jobs=2x"}), bad_jobs);
+
+    CHECK(parse({file, "-m5"}) == result(default_spec, {}, {false, 5, false}));
+    CHECK(parse({file, "--max-count=100", "-q"})
+          == result(default_spec, {}, {false, 100, true}));
+    CHECK(parse({file, "--quiet"}) == result(default_spec, {}, {false, 0, true}));
+    CHECK_THROWS_AS(parse({file, "-m0"}), bad_count);
+    CHECK_THROWS_AS(parse({file, "--max-count=x"}), bad_count);
+
+    auto const max = std::numeric_limits<std::streamoff>::max();
+    CHECK(parse({file, "-c"}) == result(default_spec, {Engine::fused, 0, 64 << 20, max},
+                                        {true, 0, false}));
+    CHECK(parse({file, "--histogram=1M"})
+          == result(default_spec, {Engine::fused, 0, 64 << 20, 1 << 20}));
+    CHECK(parse({file, "-b4k"}) == result(default_spec, {Engine::fused, 0, 64 << 20, 4096}));
+    CHECK(parse({file, "-b16"}) == result(default_spec, {Engine::fused, 0, 64 << 20, 16}));
+    CHECK_THROWS_AS(parse({file, "-b15"}), bad_bucket);
+    CHECK_THROWS_AS(parse({file, "-bK"}), bad_bucket);
+    CHECK_THROWS_AS(parse({file, "-b2T"}), bad_bucket);
+    CHECK_THROWS_AS(parse({file, "--histogram=99999999999G"}), bad_bucket);
+
+    auto const end = std::numeric_limits<std::streamoff>::max();
+    CHECK(parse({file, "-o100"}) == result(default_spec, {}, {}, {{100, end}}));
+    CHECK(parse({file, "--offset=0x100", "--length=2K"})
+          == result(default_spec, {}, {}, {{256, 2048}}));
+    CHECK(parse({file, "-n", "64"}) == result(default_spec, {}, {}, {{0, 64}}));
+    CHECK(parse({file, "-r0x10:0x20"}) == result(default_spec, {}, {}, {{16, 16}}));
+    CHECK(parse({file, "--region=1M:"}) == result(default_spec, {}, {}, {{1 << 20, end}}));
+    // Regions are sorted and joined.
+    CHECK(parse({file, "-r300:400", "-r0:100", "-r350:500", "-r100:200"})
+          == result(default_spec, {}, {}, {{0, 200}, {300, 200}}));
+    CHECK(parse({file, "-r10:20", "-r15:", "-o100", "-n10"})
+          == result(default_spec, {}, {}, {{10, end}}));
+    CHECK_THROWS_AS(parse({file, "-o-1"}), bad_region);
+    CHECK_THROWS_AS(parse({file, "-nx"}), bad_region);
+    CHECK_THROWS_AS(parse({file, "-o0x"}), bad_region);
+    CHECK_THROWS_AS(parse({file, "-r20"}), bad_region);
+    CHECK_THROWS_AS(parse({file, "-r20:10"}), bad_region);
+    CHECK_THROWS_AS(parse({file, "-r20:20"}), bad_region);
+    CHECK_THROWS_AS(parse({file, "-r:20"}), bad_region);
 }
@@ -0,0 +1,70 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "mapped_file.hh"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+Mapped_File::Mapped_File(std::string const& file, std::uint64_t offset,
+                         std::uint64_t length)
+{
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd == -1)
+        throw bad_file(file, std::strerror(errno));
+
+    struct stat status;
+    if (::fstat(fd, &status) == -1)
+    {
+        auto error = errno;
+        ::close(fd);
+        throw bad_file(file, std::strerror(error));
+    }
+    std::uint64_t const file_size = status.st_size;
+    offset = std::min(offset, file_size);
+    m_size = std::min(length, file_size - offset);
+    // mmap() fails for empty files. Leave the view empty instead.
+    if (m_size > 0)
+    {
+        // Mappings must start on a page boundary.
+        auto const page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+        auto const start = offset / page * page;
+        m_map_size = m_size + (offset - start);
+        m_map = ::mmap(nullptr, m_map_size, PROT_READ, MAP_PRIVATE, fd, start);
+        if (m_map == MAP_FAILED)
+        {
+            auto error = errno;
+            ::close(fd);
+            m_map = nullptr;
+            throw bad_file(file, std::strerror(error));
+        }
+        // No MADV_SEQUENTIAL: it slows cold scans of chunks that are read in parallel.
+        m_data = static_cast<std::byte const*>(m_map) + (offset - start);
+    }
+    // The mapping stays valid after the file is closed.
+    ::close(fd);
+}
+
+Mapped_File::~Mapped_File()
+{
+    if (m_map)
+        ::munmap(m_map, m_map_size);
+}
@@ -0,0 +1,59 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INSPECT_INSPECT_BINARY_MAPPED_FILE_HH_INCLUDED
+#define INSPECT_INSPECT_BINARY_MAPPED_FILE_HH_INCLUDED
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+
+/// A read-only view of a file's contents mapped into memory. The mapping is shared by
+/// everything that scans the file, so the file is never copied.
+class Mapped_File
+{
+public:
+    /// Map the named file, or just the part of it that starts at 'offset' and has
+    /// 'length' bytes. The part is cut short at the end of the file. Throw bad_file if it
+    /// can't be opened or mapped.
+    Mapped_File(std::string const& file, std::uint64_t offset = 0,
+                std::uint64_t length = std::numeric_limits<std::uint64_t>::max());
+    Mapped_File(Mapped_File const&) = delete;
+    Mapped_File& operator=(Mapped_File const&) = delete;
+    ~Mapped_File();
+
+    /// @return The contents of the file. Valid for the lifetime of this object.
+    std::span<std::byte const> data() const { return {m_data, m_size}; }
+
+private:
+    std::byte const* m_data = nullptr;
+    std::size_t m_size = 0;
+    /// The mapping starts on a page boundary at or before the data.
+    void* m_map = nullptr;
+    std::size_t m_map_size = 0;
+};
+
+/// Exception raised when a file can't be read.
+struct bad_file : public std::runtime_error
+{
+    bad_file(std::string const& file, std::string const& reason)
+        : runtime_error{"Can't read " + file + ": " + reason}
+    {}
+};
+
+#endif // INSPECT_INSPECT_BINARY_MAPPED_FILE_HH_INCLUDED
@@ -0,0 +1,81 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "output.hh"
+
+#include <cerrno>
+#include <cstring>
+
+#include <unistd.h>
+
+Fd_Writer::Fd_Writer(int fd, std::size_t capacity)
+    : m_fd(fd),
+      m_capacity(capacity)
+{
+    m_buffer.reserve(m_capacity);
+}
+
+Fd_Writer::~Fd_Writer()
+{
+    try
+    {
+        flush();
+    }
+    catch (bad_write const&)
+    {
+        // Nowhere to report it.
+    }
+}
+
+void Fd_Writer::write(std::string_view text)
+{
+    if (m_buffer.size() + text.size() > m_capacity)
+        flush();
+    // Text that doesn't fit is written without copying.
+    if (text.size() > m_capacity)
+        write_all(text);
+    else
+        m_buffer.append(text);
+}
+
+void Fd_Writer::flush()
+{
+    try
+    {
+        write_all(m_buffer);
+    }
+    catch (bad_write const&)
+    {
+        // Drop the text so the destructor doesn't try again.
+        m_buffer.clear();
+        throw;
+    }
+    m_buffer.clear();
+}
+
+void Fd_Writer::write_all(std::string_view text)
+{
+    while (!text.empty())
+    {
+        auto written = ::write(m_fd, text.data(), text.size());
+        if (written == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            throw bad_write(std::strerror(errno));
+        }
+        text.remove_prefix(written);
+    }
+}
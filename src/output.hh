@@ -0,0 +1,58 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INSPECT_INSPECT_BINARY_OUTPUT_HH_INCLUDED
+#define INSPECT_INSPECT_BINARY_OUTPUT_HH_INCLUDED
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+/// Collects text in a large buffer and writes it to a file descriptor in big blocks.
+class Fd_Writer
+{
+public:
+    /// @param fd Where to write. It's not closed.
+    /// @param capacity The number of bytes to collect before writing.
+    Fd_Writer(int fd, std::size_t capacity = 1 << 20);
+    Fd_Writer(Fd_Writer const&) = delete;
+    Fd_Writer& operator=(Fd_Writer const&) = delete;
+    /// Write what's left. Errors are ignored. Call flush() first to see them.
+    ~Fd_Writer();
+
+    /// Add text. It's written when the buffer fills.
+    void write(std::string_view text);
+    /// Write everything that's been added. Throw bad_write on failure.
+    void flush();
+
+private:
+    /// Write all of the text or throw bad_write.
+    void write_all(std::string_view text);
+
+    int const m_fd;
+    std::size_t const m_capacity;
+    std::string m_buffer;
+};
+
+/// Exception raised when output can't be written.
+struct bad_write : public std::runtime_error
+{
+    bad_write(std::string const& reason)
+        : runtime_error{"Can't write output: " + reason}
+    {}
+};
+
+#endif // INSPECT_INSPECT_BINARY_OUTPUT_HH_INCLUDED
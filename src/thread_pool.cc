@@ -0,0 +1,180 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "thread_pool.hh"
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <utility>
+
+#include <sched.h>
+
+/// @return The CPU limit from a cgroup quota and period, or 0 if there isn't one.
+unsigned quota_cpus(std::string const& quota, std::string const& period)
+{
+    try
+    {
+        auto q = std::stol(quota);
+        auto p = std::stol(period);
+        if (q > 0 && p > 0)
+            return std::max((q + p - 1) / p, 1l);
+    }
+    catch (std::exception const&)
+    {
+        // "max" or garbage: no limit.
+    }
+    return 0;
+}
+
+/// @return The CPU limit of the process's cgroup, or 0 if there isn't one.
+unsigned cgroup_cpus()
+{
+    // cgroup v2: the "0::<path>" line of /proc/self/cgroup gives the group.
+    std::string path;
+    std::ifstream groups("/proc/self/cgroup");
+    for (std::string line; std::getline(groups, line);)
+        if (line.starts_with("0::"))
+            path = line.substr(3);
+    for (auto const& dir : {"/sys/fs/cgroup" + path, std::string("/sys/fs/cgroup")})
+    {
+        std::ifstream max(dir + "/cpu.max");
+        std::string quota, period;
+        if (max >> quota >> period)
+            return quota_cpus(quota, period);
+    }
+    // cgroup v1.
+    std::ifstream quota("/sys/fs/cgroup/cpu/cpu.cfs_quota_us");
+    std::ifstream period("/sys/fs/cgroup/cpu/cpu.cfs_period_us");
+    std::string q, p;
+    if (quota >> q && period >> p)
+        return quota_cpus(q, p);
+    return 0;
+}
+
+unsigned available_cpus()
+{
+    unsigned cpus = std::thread::hardware_concurrency();
+    cpu_set_t set;
+    if (::sched_getaffinity(0, sizeof(set), &set) == 0)
+        cpus = CPU_COUNT(&set);
+    if (auto limit = cgroup_cpus(); limit > 0)
+        cpus = std::min(cpus, limit);
+    return std::max(cpus, 1u);
+}
+
+Thread_Pool::Thread_Pool(unsigned threads)
+    : m_count(std::max(threads, 1u)),
+      m_queues(std::make_unique<Queue[]>(m_count))
+{
+    // The thread that calls run() is the first one.
+    for (unsigned i = 1; i < m_count; ++i)
+        m_threads.emplace_back(&Thread_Pool::work, this, i);
+}
+
+Thread_Pool::~Thread_Pool()
+{
+    {
+        std::lock_guard lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (auto& thread : m_threads)
+        thread.join();
+}
+
+void Thread_Pool::run(std::vector<std::function<void()>> tasks)
+{
+    {
+        std::lock_guard lock(m_mutex);
+        auto const n = threads();
+        for (size_t i = 0; i < tasks.size(); ++i)
+        {
+            auto& queue = m_queues[i * n / tasks.size()];
+            std::lock_guard queue_lock(queue.mutex);
+            queue.tasks.push_back(std::move(tasks[i]));
+        }
+        m_remaining = tasks.size();
+        ++m_batch;
+    }
+    m_wake.notify_all();
+
+    while (run_one(0))
+        ;
+    std::unique_lock lock(m_mutex);
+    m_finished.wait(lock, [this] { return m_remaining == 0; });
+    if (m_error)
+        std::rethrow_exception(std::exchange(m_error, nullptr));
+}
+
+void Thread_Pool::work(size_t self)
+{
+    size_t batch = 0;
+    while (true)
+    {
+        {
+            std::unique_lock lock(m_mutex);
+            m_wake.wait(lock, [&] { return m_stop || m_batch != batch; });
+            if (m_stop)
+                return;
+            batch = m_batch;
+        }
+        while (run_one(self))
+            ;
+    }
+}
+
+bool Thread_Pool::run_one(size_t self)
+{
+    std::function<void()> task;
+    auto const n = threads();
+    // Take from the front of the thread's own queue first, then from the back of the
+    // others'.
+    for (size_t i = 0; i < n && !task; ++i)
+    {
+        auto& queue = m_queues[(self + i) % n];
+        std::lock_guard lock(queue.mutex);
+        if (queue.tasks.empty())
+            continue;
+        if (i == 0)
+        {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+        }
+        else
+        {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+        }
+    }
+    if (!task)
+        return false;
+
+    std::exception_ptr error;
+    try
+    {
+        task();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    std::lock_guard lock(m_mutex);
+    if (error && !m_error)
+        m_error = error;
+    if (--m_remaining == 0)
+        m_finished.notify_all();
+    return true;
+}
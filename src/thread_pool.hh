@@ -0,0 +1,78 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef INSPECT_INSPECT_BINARY_THREAD_POOL_HH_INCLUDED
+#define INSPECT_INSPECT_BINARY_THREAD_POOL_HH_INCLUDED
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// @return The number of CPUs this process may run on. Takes the CPU affinity mask and
+///    the cgroup CPU quota into account. At least 1.
+unsigned available_cpus();
+
+/// A fixed number of threads that run batches of tasks. Each thread has its own queue.
+/// Tasks are dealt out in order in contiguous runs, so a thread that scans chunks of a
+/// file reads forward through its part. A thread that empties its queue steals from the
+/// back of another thread's queue.
+class Thread_Pool
+{
+public:
+    /// @param threads The number of threads that run tasks, including the one that calls
+    ///    run().
+    Thread_Pool(unsigned threads);
+    Thread_Pool(Thread_Pool const&) = delete;
+    Thread_Pool& operator=(Thread_Pool const&) = delete;
+    ~Thread_Pool();
+
+    /// @return The number of threads that run tasks.
+    unsigned threads() const { return m_count; }
+    /// Run the tasks and wait for all of them to finish. If any task throws, the first
+    /// exception is rethrown after the others finish.
+    void run(std::vector<std::function<void()>> tasks);
+
+private:
+    /// Wait for batches and help run them.
+    void work(std::size_t self);
+    /// Run a task from the thread's own queue, or steal one.
+    /// @return False if there was no task to run.
+    bool run_one(std::size_t self);
+
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+    unsigned const m_count;
+    std::unique_ptr<Queue[]> m_queues;
+    std::vector<std::thread> m_threads;
+
+    std::mutex m_mutex; ///< Guards the rest of the members.
+    std::condition_variable m_wake; ///< Signaled when a batch starts or the pool stops.
+    std::condition_variable m_finished; ///< Signaled when a batch is finished.
+    std::size_t m_batch = 0; ///< Count of batches started.
+    std::size_t m_remaining = 0; ///< Tasks in the current batch that haven't finished.
+    std::exception_ptr m_error;
+    bool m_stop = false;
+};
+
+#endif // INSPECT_INSPECT_BINARY_THREAD_POOL_HH_INCLUDED
@@ -14,10 +14,17 @@
 // If not, see <http://www.gnu.org/licenses/>.
 
 #include "../src/inspect.hh"
+#include "../src/mapped_file.hh"
 #include "doctest.h"
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
 
 TEST_CASE("empty file")
 {
@@ -35,8 +42,8 @@ TEST_CASE("double")
     CHECK(out.size() == 8);
     auto it = out.begin();
     CHECK(it->address == 0x0);
-    CHECK(it->value == "1.23");
-    CHECK(it->type == "f64");
+    CHECK(out.value(*it) == "1.23");
+    CHECK(to_string(it->type) == "f64");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 4);
     CHECK(fmt[0] == "0000000 0                 f64 1.23");
@@ -53,8 +60,8 @@ TEST_CASE("float")
     CHECK(out.size() == 14);
     auto it = out.begin();
     CHECK(it->address == 0x4);
-    CHECK(it->value == "1.90375");
-    CHECK(it->type == "f32");
+    CHECK(out.value(*it) == "1.90375");
+    CHECK(to_string(it->type) == "f32");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 7);
     CHECK(fmt[0] == "0000000     4             f32 1.90375");
@@ -70,20 +77,20 @@ TEST_CASE("positive int")
     CHECK(out.size() == 4);
     auto it = out.begin();
     CHECK(it->address == 0x8);
-    CHECK(it->value == "432");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "432");
+    CHECK(to_string(it->type) == "i32");
     ++it;
     CHECK(it->address == 0x47);
-    CHECK(it->value == "255");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "255");
+    CHECK(to_string(it->type) == "i32");
     ++it;
     CHECK(it->address == 0x53);
-    CHECK(it->value == "256");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "256");
+    CHECK(to_string(it->type) == "i32");
     ++it;
     CHECK(it->address == 0x5f);
-    CHECK(it->value == "75");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "75");
+    CHECK(to_string(it->type) == "i32");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 4);
     CHECK(fmt[0] == "0000000         8         i32 432");
@@ -100,12 +107,12 @@ TEST_CASE("positive and negative ints")
     CHECK(out.size() == 13);
     auto it = out.begin();
     CHECK(it->address == 0x44);
-    CHECK(it->value == "-1");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "-1");
+    CHECK(to_string(it->type) == "i32");
     ++it;
     CHECK(it->address == 0x48);
-    CHECK(it->value == "0");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "0");
+    CHECK(to_string(it->type) == "i32");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 6);
     CHECK(fmt[0] == "0000004     4             i32 -1");
@@ -124,17 +131,17 @@ TEST_CASE("short")
     CHECK(out.size() == 8);
     auto it = out.begin();
     CHECK(it->address == 0x9);
-    CHECK(it->value == "1");
-    CHECK(it->type == "i16");
+    CHECK(out.value(*it) == "1");
+    CHECK(to_string(it->type) == "i16");
     ++it;
     CHECK(it->address == 0x16);
-    CHECK(it->value == "111");
-    CHECK(it->type == "i16");
+    CHECK(out.value(*it) == "111");
+    CHECK(to_string(it->type) == "i16");
     ++it;
     ++it;
     CHECK(it->address == 0x29);
-    CHECK(it->value == "119");
-    CHECK(it->type == "i16");
+    CHECK(out.value(*it) == "119");
+    CHECK(to_string(it->type) == "i16");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 7);
     CHECK(fmt[0] == "0000000          9        i16 1");
@@ -153,8 +160,8 @@ TEST_CASE("long")
     auto out = inspect(is, spec);
     auto it = out.begin();
     CHECK(it->address == 0xc);
-    CHECK(it->value == "72038902055038719"); // 0x00ffeeffeeffeeff
-    CHECK(it->type == "i64");
+    CHECK(out.value(*it) == "72038902055038719"); // 0x00ffeeffeeffeeff
+    CHECK(to_string(it->type) == "i64");
     auto fmt = format_report(out);
     CHECK(fmt[0] == "0000000             c     i64 72038902055038719");
 }
@@ -166,8 +173,8 @@ TEST_CASE("negative int")
     auto out = inspect(is, spec);
     auto it = out.begin();
     CHECK(it->address == 0x44);
-    CHECK(it->value == "-1");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "-1");
+    CHECK(to_string(it->type) == "i32");
     auto fmt = format_report(out);
     CHECK(fmt[0] == "0000004     4             i32 -1");
 }
@@ -179,12 +186,12 @@ TEST_CASE("overlapping negative ints")
     auto out = inspect(is, spec);
     auto it = out.begin();
     CHECK(it->address == 0x43);
-    CHECK(it->value == "-256");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "-256");
+    CHECK(to_string(it->type) == "i32");
     ++it;
     CHECK(it->address == 0x44);
-    CHECK(it->value == "-1");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "-1");
+    CHECK(to_string(it->type) == "i32");
     auto fmt = format_report(out);
     CHECK(fmt[0] == "0000004    3              i32 -256");
     CHECK(fmt[1] == "            4             i32 -1");
@@ -207,20 +214,20 @@ TEST_CASE("zeros")
     auto out = inspect(is, spec);
     auto it = out.begin();
     CHECK(it->address == 0x48);
-    CHECK(it->value == "0");
-    CHECK(it->type == "f64");
+    CHECK(out.value(*it) == "0");
+    CHECK(to_string(it->type) == "f64");
     ++it;
     CHECK(it->address == 0x49);
-    CHECK(it->value == "0");
-    CHECK(it->type == "f64");
+    CHECK(out.value(*it) == "0");
+    CHECK(to_string(it->type) == "f64");
     std::advance(it, 4);
     CHECK(it->address == 0x48);
-    CHECK(it->value == "0");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "0");
+    CHECK(to_string(it->type) == "i32");
     ++it;
     CHECK(it->address == 0x49);
-    CHECK(it->value == "0");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "0");
+    CHECK(to_string(it->type) == "i32");
     auto fmt = format_report(out);
     CHECK(fmt[0] == "0000004         89abc     f64 0");
     CHECK(fmt[1] == "                89abcdef  i32 0");
@@ -239,36 +246,36 @@ TEST_CASE("all numbers")
     auto out = inspect(is, spec);
     auto it = out.begin();
     CHECK(it->address == 0x4);
-    CHECK(it->value == "1.90375");
-    CHECK(it->type == "f32");
+    CHECK(out.value(*it) == "1.90375");
+    CHECK(to_string(it->type) == "f32");
     ++it;
     CHECK(it->address == 0x0);
-    CHECK(it->value == "1.23");
-    CHECK(it->type == "f64");
+    CHECK(out.value(*it) == "1.23");
+    CHECK(to_string(it->type) == "f64");
     ++it;
     CHECK(it->address == 0x9);
-    CHECK(it->value == "1");
-    CHECK(it->type == "i16");
+    CHECK(out.value(*it) == "1");
+    CHECK(to_string(it->type) == "i16");
     ++it;
     CHECK(it->address == 0xc);
-    CHECK(it->value == "72038902055038719");
-    CHECK(it->type == "i64");
+    CHECK(out.value(*it) == "72038902055038719");
+    CHECK(to_string(it->type) == "i64");
     std::advance(it, 3);
     CHECK(it->address == 0x54);
-    CHECK(it->value == "1");
-    CHECK(it->type == "i16");
+    CHECK(out.value(*it) == "1");
+    CHECK(to_string(it->type) == "i16");
     ++it;
     CHECK(it->address == 0x5f);
-    CHECK(it->value == "75");
-    CHECK(it->type == "i16");
+    CHECK(out.value(*it) == "75");
+    CHECK(to_string(it->type) == "i16");
     ++it;
     CHECK(it->address == 0x54);
-    CHECK(it->value == "1");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "1");
+    CHECK(to_string(it->type) == "i32");
     ++it;
     CHECK(it->address == 0x5f);
-    CHECK(it->value == "75");
-    CHECK(it->type == "i32");
+    CHECK(out.value(*it) == "75");
+    CHECK(to_string(it->type) == "i32");
     auto fmt = format_report(out);
     // Sort by name of type within a row. This may puts some entries out of address order.
     CHECK(fmt[0] ==  "0000000     4             f32 1.90375");
@@ -291,12 +298,12 @@ TEST_CASE("zero-length string")
     auto out = inspect(is, spec);
     auto it = out.begin();
     CHECK(it->address == 0x0a);
-    CHECK(it->value == "");
-    CHECK(it->type == "s8");
+    CHECK(out.value(*it) == "");
+    CHECK(to_string(it->type) == "s8");
     ++it;
     ++it;
     CHECK(it->address == 0x14);
-    CHECK(it->value == "moo");
+    CHECK(out.value(*it) == "moo");
     auto fmt = format_report(out);
     CHECK(fmt[0] == "0000000           ab      s8  ");
     CHECK(fmt[1] == "0000001     4   8         s8  moo");
@@ -307,8 +314,8 @@ TEST_CASE("short string")
     auto check = [](Report const& out) {
         auto it = out.begin();
         CHECK(it->address == 0x14);
-        CHECK(it->value == "moo");
-        CHECK(it->type == "s8");
+        CHECK(out.value(*it) == "moo");
+        CHECK(to_string(it->type) == "s8");
         auto fmt = format_report(out);
         CHECK(fmt[0] == "0000001     4   8         s8  moo");
     };
@@ -343,8 +350,8 @@ TEST_CASE("long string")
     CHECK(out.size() == 1);
     auto it = out.begin();
     CHECK(it->address == 0x1c);
-    CHECK(it->value == "w\346e\376ing w\357ll\370w"); // "wæeÞing wïlløw");
-    CHECK(it->type == "s8");
+    CHECK(out.value(*it) == "w\346e\376ing w\357ll\370w"); // "wæeÞing wïlløw");
+    CHECK(to_string(it->type) == "s8");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 1);
     CHECK(fmt[0] == "0000001             c     s8  w\346e\376ing w\357ll\370w");
@@ -366,12 +373,12 @@ TEST_CASE("16-bit char string")
     CHECK(out.size() == 2);
     auto it = out.begin();
     CHECK(it->address == 0x12);
-    CHECK(it->value == "\377moo");
-    CHECK(it->type == "s16");
+    CHECK(out.value(*it) == "\377moo");
+    CHECK(to_string(it->type) == "s16");
     ++it;
     CHECK(it->address == 0x1c);
-    CHECK(it->value == "moo");
-    CHECK(it->type == "s16");
+    CHECK(out.value(*it) == "moo");
+    CHECK(to_string(it->type) == "s16");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 2);
     CHECK(fmt[0] == "0000001   2               s16 \377moo");
@@ -386,12 +393,12 @@ TEST_CASE("8-bit ASCII")
     CHECK(out.size() == 2);
     auto it = out.begin();
     CHECK(it->address == 0x14);
-    CHECK(it->value == "moo");
-    CHECK(it->type == "a8");
+    CHECK(out.value(*it) == "moo");
+    CHECK(to_string(it->type) == "a8");
     ++it;
     CHECK(it->address == 0x18);
-    CHECK(it->value == "moo");
-    CHECK(it->type == "a8");
+    CHECK(out.value(*it) == "moo");
+    CHECK(to_string(it->type) == "a8");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 1);
     CHECK(fmt[0] == "0000001     4   8         a8  moo");
@@ -405,12 +412,12 @@ TEST_CASE("16-bit ASCII")
     CHECK(out.size() == 2);
     auto it = out.begin();
     CHECK(it->address == 0x14);
-    CHECK(it->value == "moo");
-    CHECK(it->type == "a16");
+    CHECK(out.value(*it) == "moo");
+    CHECK(to_string(it->type) == "a16");
     ++it;
     CHECK(it->address == 0x1c);
-    CHECK(it->value == "moo");
-    CHECK(it->type == "a16");
+    CHECK(out.value(*it) == "moo");
+    CHECK(to_string(it->type) == "a16");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 1);
     CHECK(fmt[0] == "0000001     4       c     a16 moo");
@@ -424,8 +431,8 @@ TEST_CASE("long 16-bit char string")
     CHECK(out.size() == 1);
     auto it = out.begin();
     CHECK(it->address == 0x24);
-    CHECK(it->value == "w\346e\376ing w\357ll\370w"); // "wæeÞing wïlløw");
-    CHECK(it->type == "s16");
+    CHECK(out.value(*it) == "w\346e\376ing w\357ll\370w"); // "wæeÞing wïlløw");
+    CHECK(to_string(it->type) == "s16");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 1);
     CHECK(fmt[0] == "0000002     4             s16 w\346e\376ing w\357ll\370w");
@@ -448,17 +455,17 @@ TEST_CASE("split string")
     auto it = out.begin();
     ++it;
     CHECK(it->address == 0x2b);
-    CHECK(it->value == "first");
-    CHECK(it->type == "s8");
+    CHECK(out.value(*it) == "first");
+    CHECK(to_string(it->type) == "s8");
     ++it;
     CHECK(it->address == 0x31);
-    CHECK(it->value == "second");
+    CHECK(out.value(*it) == "second");
     ++it;
     CHECK(it->address == 0x38);
-    CHECK(it->value == "third");
+    CHECK(out.value(*it) == "third");
     ++it;
     CHECK(it->address == 0x3e);
-    CHECK(it->value == "third");
+    CHECK(out.value(*it) == "third");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 4);
     CHECK(fmt[1] == "0000002            b      s8  first");
@@ -474,17 +481,17 @@ TEST_CASE("split 16-bit string")
     CHECK(out.size() == 4);
     auto it = out.begin();
     CHECK(it->address == 0x43);
-    CHECK(it->value == "first");
-    CHECK(it->type == "s16");
+    CHECK(out.value(*it) == "first");
+    CHECK(to_string(it->type) == "s16");
     ++it;
     CHECK(it->address == 0x4f);
-    CHECK(it->value == "second");
+    CHECK(out.value(*it) == "second");
     ++it;
     CHECK(it->address == 0x5d);
-    CHECK(it->value == "third");
+    CHECK(out.value(*it) == "third");
     ++it;
     CHECK(it->address == 0x69);
-    CHECK(it->value == "third");
+    CHECK(out.value(*it) == "third");
     auto fmt = format_report(out);
     CHECK(fmt.size() == 4);
     CHECK(fmt[0] == "0000004    3              s16 first");
@@ -493,6 +500,30 @@ TEST_CASE("split 16-bit string")
     CHECK(fmt[3] == "0000006          9        s16 third");
 }
 
+TEST_CASE("mixed character sets")
+{
+    // Latin-1 and ASCII strings in the same pass don't depend on a global locale.
+    std::string content("caf\xe9\0tea\0", 9);
+    Spec spec{{"s8", {"3", "8"}}, {"a8", {"3", "8"}}};
+    for (auto engine : {Engine::stream, Engine::buffer, Engine::fused})
+    {
+        auto out = inspect(std::as_bytes(std::span(content)), spec, {engine});
+        REQUIRE(out.size() == 3);
+        // Sorted by type within a row.
+        auto it = out.begin();
+        CHECK(it->address == 5);
+        CHECK(out.value(*it) == "tea");
+        CHECK(to_string(it->type) == "a8");
+        ++it;
+        CHECK(it->address == 0);
+        CHECK(out.value(*it) == "caf\xe9");
+        CHECK(to_string(it->type) == "s8");
+        ++it;
+        CHECK(it->address == 5);
+        CHECK(to_string(it->type) == "s8");
+    }
+}
+
 TEST_CASE("unknown type")
 {
     std::ifstream is("../test/test_data");
@@ -505,4 +536,629 @@ TEST_CASE("bad range")
     std::ifstream is("../test/test_data");
     Spec spec{{"i32", {"4", "-10"}}};
     CHECK_THROWS_AS(inspect(is, spec), bad_range);
+    // String lengths are at most 2^32 - 1.
+    CHECK_THROWS_AS(inspect(is, {{"s8", {"5000000000", "6000000000"}}}), bad_range);
+    std::ifstream file("../test/test_data");
+    std::string const data{std::istreambuf_iterator<char>(file),
+                           std::istreambuf_iterator<char>()};
+    CHECK(format_report(inspect(std::as_bytes(std::span(data)),
+                                {{"s8", {"3", "6000000000"}}}))
+          == format_report(inspect(std::as_bytes(std::span(data)),
+                                   {{"s8", {"3", "4294967295"}}})));
+}
+
+TEST_CASE("mapped file")
+{
+    Spec spec{{"f64", {"-1e6", "1e6", "1e-6"}},
+              {"i32", {"-1000", "1000"}},
+              {"a8", {"3", "64"}}};
+    std::ifstream is("../test/test_data");
+    auto expected = format_report(inspect(is, spec));
+    Mapped_File file("../test/test_data");
+    CHECK(file.data().size() == 120);
+    CHECK(format_report(inspect(file.data(), spec)) == expected);
+}
+
+TEST_CASE("mapped part of a file")
+{
+    std::ifstream is("../test/test_data");
+    std::string const content{std::istreambuf_iterator<char>(is),
+                              std::istreambuf_iterator<char>()};
+    auto const check = [&content](std::size_t offset, std::size_t length,
+                                  std::size_t size) {
+        Mapped_File file("../test/test_data", offset, length);
+        auto const data = file.data();
+        REQUIRE(data.size() == size);
+        CHECK(std::string(reinterpret_cast<char const*>(data.data()), size)
+              == content.substr(std::min(offset, content.size()), size));
+    };
+    check(0, 120, 120);
+    check(17, 30, 30);
+    check(100, 1000, 20);
+    check(120, 10, 0);
+    check(5000, 10, 0);
+}
+
+TEST_CASE("mapped empty file")
+{
+    Mapped_File file("../test/empty_file");
+    CHECK(file.data().empty());
+    CHECK(inspect(file.data(), {{"i32", {"-1000", "1000"}}}).empty());
+}
+
+TEST_CASE("missing file")
+{
+    CHECK_THROWS_AS(Mapped_File("../test/no_such_file"), bad_file);
+}
+
+/// @return The contents of a file.
+std::string read_file(std::string const& file)
+{
+    std::ifstream is(file);
+    return {std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>()};
+}
+
+/// @return Pseudo-random bytes with runs of zeros, small numbers and printable
+///    characters mixed in so that every type has matches.
+std::string test_bytes(size_t size, unsigned seed = 1)
+{
+    std::mt19937 gen(seed);
+    std::string out;
+    while (out.size() < size)
+    {
+        auto n = gen() % 24;
+        switch (gen() % 6)
+        {
+        case 0:
+            out.append(n, '\0');
+            break;
+        case 1:
+            for (size_t i = 0; i < n; ++i)
+                out.push_back(" tacocat\t\n\r"[gen() % 11]);
+            break;
+        case 2:
+            // A wide string.
+            for (size_t i = 0; i < n; ++i)
+                out.append({"eimnorst"[gen() % 8], '\0'});
+            break;
+        case 3:
+            for (size_t i = 0; i < n; ++i)
+                out.push_back(static_cast<char>(0xa0 + gen() % 0x60));
+            break;
+        default:
+            for (size_t i = 0; i < n; ++i)
+                out.push_back(static_cast<char>(gen()));
+            break;
+        }
+    }
+    out.resize(size);
+    return out;
+}
+
+/// A spec with every type and ranges that give lots of matches.
+Spec const all_types{{"f64", {"-1e6", "1e6", "1e-6"}},
+                     {"f32", {"-1e3", "1e6", "1e-3"}},
+                     {"i64", {"-1000", "1000"}},
+                     {"i32", {"-1000", "1000"}},
+                     {"i16", {"-100", "0x3fff"}},
+                     {"s16", {"2", "8"}},
+                     {"s8", {"0", "12"}},
+                     {"a16", {"1", "4"}},
+                     {"a8", {"3", "64"}}};
+
+/// Check that the engine gives the same report as the stream engine.
+void check_engine(std::string const& content, Spec const& spec, Engine engine,
+                  unsigned jobs = 0)
+{
+    auto data = std::as_bytes(std::span(content));
+    auto expected = inspect(data, spec, {Engine::stream});
+    auto out = inspect(data, spec, {engine, jobs});
+    REQUIRE(out.size() == expected.size());
+    auto it = expected.begin();
+    for (auto const& entry : out)
+    {
+        CHECK(entry.address == it->address);
+        CHECK(out.value(entry) == expected.value(*it));
+        CHECK(entry.type == it->type);
+        ++it;
+    }
+}
+
+TEST_CASE("buffer engine")
+{
+    check_engine(read_file("../test/test_data"), all_types, Engine::buffer);
+    check_engine(read_file("../test/test_data_wide"), all_types, Engine::buffer);
+    check_engine(test_bytes(0x10000), all_types, Engine::buffer);
+    // Odd sizes exercise the end of the data.
+    for (size_t size = 0; size < 20; ++size)
+        check_engine(test_bytes(size, size), all_types, Engine::buffer);
+}
+
+TEST_CASE("fused engine")
+{
+    check_engine(read_file("../test/test_data"), all_types, Engine::fused);
+    check_engine(read_file("../test/test_data_wide"), all_types, Engine::fused);
+    check_engine(test_bytes(0x10000), all_types, Engine::fused);
+    for (size_t size = 0; size < 20; ++size)
+        check_engine(test_bytes(size, size), all_types, Engine::fused);
+    // Strings of all lengths and parities around the limits and across blocks.
+    std::string strings;
+    for (size_t i = 0; strings.size() < 0x12000; ++i)
+    {
+        std::string word(i % 23, 'a' + i % 26);
+        if (i % 3 == 0)
+            for (size_t j = 0; j < word.size(); j += 2)
+                word[j] = '\0';
+        strings += word + std::string(i % 4 == 0 ? 2 : 1, "\0\t\n\r\1"[i % 5]);
+    }
+    check_engine(strings, {{"s8", {"0", "8"}}, {"a16", {"3", "8"}}, {"s16", {"0", "3"}},
+                           {"a8", {"8", "8"}}, {"s16", {"7", "20"}}}, Engine::fused);
+    // Repeated types and a mix of Latin-1 and ASCII in the same pass.
+    check_engine(test_bytes(0x9000, 7),
+                 {{"a8", {"1", "5"}}, {"s8", {"1", "5"}}, {"a8", {"3", "7"}},
+                  {"i32", {"0", "0"}}, {"i32", {"-5", "5"}}},
+                 Engine::fused);
+}
+
+/// Check that the fused engine gives the same report for any number of jobs.
+void check_jobs(std::string const& content, Spec const& spec)
+{
+    check_engine(content, spec, Engine::fused, 1);
+    auto data = std::as_bytes(std::span(content));
+    auto expected = format_report(inspect(data, spec, {Engine::fused, 1}));
+    // Chunks are at least 16 KiB, so many jobs give chunks of 1 or 2 blocks.
+    for (unsigned jobs : {2, 3, 5, 16})
+    {
+        CAPTURE(jobs);
+        CHECK(format_report(inspect(data, spec, {Engine::fused, jobs})) == expected);
+    }
+}
+
+/// @return Strings up to a few KiB long in both byte parities that cross chunk and
+///    window boundaries.
+std::string long_strings()
+{
+    std::string strings;
+    for (size_t i = 0; strings.size() < 0x40000; ++i)
+    {
+        std::string word(i % 4093, 'a' + i % 26);
+        if (i % 3 == 0)
+            for (size_t j = 0; j < word.size(); j += 2)
+                word[j] = '\0';
+        strings += word + std::string(1 + i % 2, "\0\t\n\1"[i % 4]);
+    }
+    return strings;
+}
+
+Spec const long_string_types{{"s8", {"0", "5000"}}, {"a16", {"3", "4000"}},
+                             {"s16", {"0", "3"}}, {"a8", {"100", "200"}}};
+
+TEST_CASE("parallel chunks")
+{
+    check_jobs(test_bytes(0x30000, 3), all_types);
+    check_jobs(long_strings(), long_string_types);
+    // A string longer than a chunk, and data with no bytes that can't be in a string.
+    check_jobs(std::string(0x11001, 'x') + '\0' + test_bytes(0x20000), all_types);
+    check_jobs(std::string(0x30000, '\0'), {{"s8", {"0", "12"}}, {"s16", {"0", "3"}}});
+    check_jobs(std::string(0x30001, 'x'), all_types);
+}
+
+/// @return The report lines sent to a sink, formatted a part at a time. Check that each
+///    part starts in a later row than the previous one ended.
+template <typename Data>
+std::vector<std::string> streamed_report(Data&& data, Spec const& spec,
+                                         Settings const& settings)
+{
+    std::vector<std::string> out;
+    std::streamoff last_row = -1;
+    inspect(data, spec, settings, [&](Report const& part) {
+        REQUIRE(!part.empty());
+        CHECK((part.begin()->address >> 4) > last_row);
+        last_row = std::prev(part.end())->address >> 4;
+        auto lines = format_report(part);
+        out.insert(out.end(), lines.begin(), lines.end());
+        return true;
+    });
+    return out;
+}
+
+/// Check that scanning in windows gives the same report as scanning all of it at once.
+void check_windows(std::string const& content, Spec const& spec)
+{
+    auto const data = std::as_bytes(std::span(content));
+    auto expected = format_report(inspect(data, spec));
+    // Windows are at least 16 KiB.
+    for (size_t window : {0, 0x4001, 0x6a5b, 0x100000})
+        for (unsigned jobs : {1, 3})
+        {
+            CAPTURE(window);
+            CAPTURE(jobs);
+            Settings const settings{Engine::fused, jobs, window};
+            std::istringstream is(content);
+            CHECK(format_report(inspect(is, spec, settings)) == expected);
+            is = std::istringstream(content);
+            CHECK(streamed_report(is, spec, settings) == expected);
+            CHECK(streamed_report(data, spec, settings) == expected);
+        }
+}
+
+TEST_CASE("stream windows")
+{
+    check_windows(test_bytes(0x30000, 5), all_types);
+    check_windows(long_strings(), long_string_types);
+    // A string that's longer than a window is kept until it ends.
+    auto const long_string = std::string(0x11001, 'x') + '\0' + test_bytes(0x20000);
+    check_windows(long_string, {{"s8", {"3", "0x20000"}}, {"a8", {"3", "64"}}});
+    check_windows(std::string(0x30001, 'x'), all_types);
+    check_windows("", all_types);
+
+    std::istringstream is(long_string);
+    auto out = inspect(is, {{"s8", {"0x11001", "0x11001"}}}, {Engine::fused, 1, 0x4000});
+    REQUIRE(out.size() == 1);
+    CHECK(out.begin()->address == 0);
+    CHECK(out.value(*out.begin()) == std::string(0x11001, 'x'));
+}
+
+/// @return Data that makes string searches do the most work: runs of good characters in
+///    both byte parities just shorter and just longer than the limits, and runs longer
+///    than a chunk.
+std::string hard_strings()
+{
+    std::string out;
+    for (size_t i = 0; out.size() < 0x60000; ++i)
+    {
+        auto const length = std::array<size_t, 8>{1, 2, 3, 63, 64, 65, 0x4001, 0x9000}[i % 8];
+        for (size_t j = 0; j < length; ++j)
+            out += i % 3 == 0 ? std::string{'x', '\0'} : std::string{'x'};
+        out.append(1 + i % 2, "\0\1\t"[i % 3]);
+    }
+    // 1-character strings.
+    for (size_t i = 0; i < 0x8000; ++i)
+        out += {'A', '\0'};
+    return out + std::string(0x20001, 'y');
+}
+
+TEST_CASE("bounded string rework")
+{
+    // Strings just too long or too short to show, near and across chunk boundaries.
+    auto const data = hard_strings();
+    check_jobs(data, {{"s8", {"3", "64"}}, {"s16", {"3", "64"}}, {"a8", {"64", "0x4001"}},
+                      {"a16", {"2", "0x8000"}}});
+    check_jobs(data, {{"s8", {"0x4001", "0x4001"}}, {"s16", {"0", "1"}}});
+    check_windows(data, {{"s8", {"65", "0x9000"}}, {"a16", {"64", "65"}}});
+
+    // Short strings between terminators, which make a wide string longer than a chunk in
+    // the first case.
+    std::string wide, narrow;
+    for (size_t i = 0; i < 0x18000; ++i)
+    {
+        wide += {'w', '\0'};
+        narrow += {'a', 'b', '\0'};
+    }
+    for (auto const& content : {wide, narrow})
+        check_jobs(content, {{"s8", {"1", "3"}}, {"s16", {"2", "100"}}, {"a16", {"0", "0"}},
+                             {"s16", {"0x10000", "0x40000"}}});
+}
+
+TEST_CASE("report")
+{
+    CHECK(to_type("s16") == Type::s16);
+    CHECK(to_string(Type::i64) == "i64");
+    CHECK_THROWS_AS(to_type("i8"), unknown_type);
+    CHECK(is_string(Type::a8));
+    CHECK(!is_string(Type::f32));
+
+    Report first;
+    first.add_number(0x10, Type::f32, 1.5f);
+    first.add_string(0x12, Type::s8, "abc");
+    Report second;
+    second.add_number(0x02, Type::i16, int16_t(-7));
+    second.add_string(0x14, Type::a8, "de");
+    first.merge(second);
+    REQUIRE(first.size() == 4);
+    auto it = first.begin();
+    CHECK(it->address == 0x02);
+    CHECK(first.value(*it) == "-7");
+    ++it;
+    CHECK(it->type == Type::a8);
+    CHECK(first.value(*it) == "de");
+    ++it;
+    CHECK(first.value(*it) == "1.5");
+    ++it;
+    CHECK(first.text(*it) == "abc");
+}
+
+TEST_CASE("merge reports")
+{
+    std::vector<Report> reports(3);
+    reports[0].add_string(0x00, Type::s8, "ab");
+    reports[0].add_string(0x24, Type::s8, "cd");
+    reports[2].add_string(0x08, Type::s8, "ef");
+    reports[2].add_number(0x21, Type::i16, int16_t(3));
+    reports[1].add_number(0x11, Type::i32, 4);
+    auto out = Report::merge(reports);
+    std::vector<std::string> values;
+    for (auto const& entry : out)
+        values.push_back(out.value(entry));
+    // "ef" is in the same row with the same type as "ab", so it stays after it.
+    CHECK(values == std::vector<std::string>{"ab", "ef", "4", "3", "cd"});
+    CHECK(Report::merge(std::vector<Report>()).empty());
+}
+
+TEST_CASE("stop early")
+{
+    auto const content = test_bytes(0x100000, 7);
+    auto const data = std::as_bytes(std::span(content));
+    auto const expected = format_report(inspect(data, all_types));
+    for (unsigned jobs : {1, 3})
+    {
+        CAPTURE(jobs);
+        int calls = 0;
+        Report first;
+        inspect(data, all_types, {Engine::fused, jobs}, [&](Report const& part) {
+            ++calls;
+            first = part;
+            return false;
+        });
+        CHECK(calls == 1);
+        // The first window is small.
+        auto const lines = format_report(first);
+        REQUIRE(!lines.empty());
+        CHECK(lines.size() < expected.size() / 4);
+        CHECK(std::equal(lines.begin(), lines.end(), expected.begin()));
+    }
+}
+
+/// @return The number of matches of each type in each bucket, in report order.
+std::vector<std::tuple<std::streamoff, Type, std::uint64_t>> counts(Report const& report)
+{
+    std::vector<std::tuple<std::streamoff, Type, std::uint64_t>> out;
+    for (auto const& entry : report)
+        out.emplace_back(entry.address, entry.type, std::stoull(report.value(entry)));
+    return out;
+}
+
+TEST_CASE("count matches")
+{
+    auto const content = test_bytes(0x30000, 3) + long_strings();
+    auto const data = std::as_bytes(std::span(content));
+    // Integer kernels don't test 'min', so their candidates are checked again.
+    Spec const with_min{{"i32", {"-1000", "1000", "10"}}, {"i16", {"-100", "100", "2"}},
+                        {"f32", {"-1e3", "1e6", "1e-3"}}};
+    for (auto const& spec : {all_types, with_min})
+    {
+        auto const all = inspect(data, spec);
+        for (std::streamoff bucket : {16, 100, 0x1000, 0x100000})
+        {
+            CAPTURE(bucket);
+            // Count the full report.
+            std::map<std::pair<std::streamoff, Type>, std::uint64_t> expected_counts;
+            for (auto const& entry : all)
+                ++expected_counts[{entry.address - entry.address % bucket, entry.type}];
+            std::vector<std::tuple<std::streamoff, Type, std::uint64_t>> expected;
+            for (auto const& [key, count] : expected_counts)
+                expected.emplace_back(key.first, key.second, count);
+
+            for (auto engine : {Engine::stream, Engine::buffer, Engine::fused})
+                for (unsigned jobs : {1, 3})
+                {
+                    CAPTURE(engine);
+                    CAPTURE(jobs);
+                    Settings const settings{engine, jobs, 0x4000, bucket};
+                    CHECK(counts(inspect(data, spec, settings)) == expected);
+                    std::istringstream is(content);
+                    CHECK(counts(inspect(is, spec, settings)) == expected);
+                }
+        }
+    }
+    check_engine(content, with_min, Engine::buffer);
+    check_engine(content, with_min, Engine::fused, 3);
+}
+
+TEST_CASE("format histogram")
+{
+    Report report(0x100);
+    report.add_number(0x10, Type::i32, 5);
+    report.add_number(0x20, Type::i32, 6);
+    report.add_string(0x24, Type::s8, "abc");
+    report.add_number(0x1234, Type::i32, 7);
+    CHECK(report.size() == 3);
+    std::vector<Type> const columns{Type::i32, Type::s8};
+    CHECK(histogram_header(columns) == "address          i32          s8");
+    std::vector<std::string> lines;
+    format_histogram(report, columns, [&](std::string_view line) {
+        lines.emplace_back(line);
+    });
+    CHECK(lines == std::vector<std::string>{"00000000           2           1",
+                                            "00001200           1           0"});
+}
+
+TEST_CASE("origin")
+{
+    auto const content = test_bytes(0x30000, 4) + long_strings();
+    auto const data = std::as_bytes(std::span(content));
+    auto const all = inspect(data, all_types);
+    for (auto [begin, end] : {std::pair<size_t, size_t>{0x1235, 0x2f000},
+                              {0x4000, 0x4100}, {0x10001, content.size()}})
+    {
+        CAPTURE(begin);
+        auto const part = data.subspan(begin, end - begin);
+        // Matches are the ones in the part, moved by 'begin'.
+        std::vector<std::tuple<std::streamoff, Type, std::string>> expected;
+        auto const alone = inspect(part, all_types, {Engine::stream});
+        for (auto const& entry : alone)
+            expected.emplace_back(entry.address + begin, entry.type, alone.value(entry));
+        std::sort(expected.begin(), expected.end());
+        // Numbers that are entirely in the part are the same as in the whole.
+        std::vector<std::tuple<std::streamoff, Type, std::string>> numbers;
+        for (auto const& entry : all)
+        {
+            auto const size = entry.type == Type::i16 ? 2
+                : entry.type == Type::f32 || entry.type == Type::i32 ? 4 : 8;
+            if (!is_string(entry.type) && entry.address >= std::streamoff(begin)
+                && entry.address + size <= std::streamoff(end))
+                numbers.emplace_back(entry.address, entry.type, all.value(entry));
+        }
+
+        for (auto engine : {Engine::stream, Engine::buffer, Engine::fused})
+            for (unsigned jobs : {1, 3})
+            {
+                CAPTURE(engine);
+                CAPTURE(jobs);
+                Settings settings{engine, jobs, 0x4000};
+                settings.origin = begin;
+                std::vector<std::tuple<std::streamoff, Type, std::string>> out;
+                std::vector<std::tuple<std::streamoff, Type, std::string>> out_numbers;
+                auto const report = inspect(part, all_types, settings);
+                for (auto const& entry : report)
+                {
+                    out.emplace_back(entry.address, entry.type, report.value(entry));
+                    if (!is_string(entry.type))
+                        out_numbers.push_back(out.back());
+                }
+                // Rows depend on the address, so an unaligned origin changes the order.
+                std::sort(out.begin(), out.end());
+                CHECK(out == expected);
+                CHECK(out_numbers == numbers);
+
+                // Buckets are counted from the start of the whole.
+                settings.bucket = 0x100;
+                std::map<std::pair<std::streamoff, Type>, std::uint64_t> expected_counts;
+                for (auto const& [address, type, value] : expected)
+                    ++expected_counts[{address - address % 0x100, type}];
+                std::istringstream is(content.substr(begin, end - begin));
+                std::vector<std::tuple<std::streamoff, Type, std::uint64_t>> counted;
+                for (auto const& [key, count] : expected_counts)
+                    counted.emplace_back(key.first, key.second, count);
+                CHECK(counts(inspect(is, all_types, settings)) == counted);
+            }
+    }
+}
+
+TEST_CASE("origin across chunks")
+{
+    // Strings that cross chunk boundaries are found again when the chunks are stitched.
+    // They must be moved by the origin once.
+    auto const content = long_strings();
+    auto const data = std::as_bytes(std::span(content));
+    for (std::streamoff origin : {0x10, 0x12345})
+    {
+        CAPTURE(origin);
+        Settings settings{Engine::stream};
+        settings.origin = origin;
+        auto const expected = format_report(inspect(data, long_string_types, settings));
+        settings.engine = Engine::fused;
+        settings.jobs = 3;
+        CHECK(format_report(inspect(data, long_string_types, settings)) == expected);
+    }
+}
+
+TEST_CASE("big-endian")
+{
+    std::string const content("\x00\x00\x03\xe8\x3f\xf0\x00\x00\x00\x00\x00\x00", 12);
+    std::istringstream is(content);
+    auto const out = inspect(is, {{"i32be", {"1000", "1000"}}, {"f64be", {"1", "1"}},
+                                  {"i16be", {"1000", "1000"}}});
+    CHECK(format_report(out) == std::vector<std::string>{
+            "0000000     4             f64be 1",
+            "          2               i16be 1000",
+            "        0                 i32be 1000"});
+
+    // A big-endian number is a little-endian one in the reversed data.
+    auto const data = test_bytes(0x20000, 5);
+    std::string const reversed(data.rbegin(), data.rend());
+    for (auto [type, size] : {std::pair{"i16", 2}, {"i32", 4}, {"i64", 8}, {"f32", 4},
+                              {"f64", 8}})
+    {
+        CAPTURE(type);
+        auto const range = std::string(type).starts_with("f")
+            ? Range{"-1e3", "1e6", "1e-3"} : Range{"-100", "1000"};
+        std::set<std::pair<std::streamoff, std::string>> expected;
+        auto const little = inspect(std::as_bytes(std::span(reversed)), {{type, range}});
+        for (auto const& entry : little)
+            expected.emplace(data.size() - entry.address - size, little.value(entry));
+        for (auto engine : {Engine::stream, Engine::buffer, Engine::fused})
+        {
+            CAPTURE(engine);
+            std::set<std::pair<std::streamoff, std::string>> found;
+            auto const big = inspect(std::as_bytes(std::span(data)),
+                                     {{type + std::string("be"), range}}, {engine});
+            for (auto const& entry : big)
+                found.emplace(entry.address, big.value(entry));
+            CHECK(found == expected);
+        }
+    }
+
+    // Filters for both byte orders are run together.
+    Spec const both{{"i32", {"-1000", "1000"}}, {"f64be", {"-1e6", "1e6", "1e-6"}},
+                    {"s8", {"3", "64"}}, {"i32be", {"0", "0x7fff"}},
+                    {"f64", {"-1e3", "1e6", "1e-3"}}, {"i16be", {"-100", "100"}},
+                    {"i32be", {"-5", "5"}}};
+    check_engine(test_bytes(0x10000, 6), both, Engine::buffer);
+    check_jobs(test_bytes(0x30000, 7), both);
+}
+
+TEST_CASE("aligned numbers")
+{
+    auto const content = test_bytes(0x30000, 8);
+    auto const data = std::as_bytes(std::span(content));
+    // Each type once so that matches can be traced back to their filter.
+    Spec aligned{{"f64", {"-1e6", "1e6", "1e-6"}, 8},
+                 {"f32be", {"-1e3", "1e6", "1e-3"}, 4, 2},
+                 {"i64", {"-1000", "1000"}, 128, 5},
+                 {"i32", {"-1000", "1000"}, 16, 12},
+                 {"i32be", {"-1000", "1000"}, 2},
+                 {"i16", {"-100", "0x3fff"}, 4, 1},
+                 {"i16be", {"-100", "0x3fff"}, 0x10000, 0x123},
+                 {"s8", {"3", "12"}}};
+    auto unaligned = aligned;
+    for (auto& filter : unaligned)
+        filter.align = 1, filter.phase = 0;
+    auto const stride = [&aligned](Type type) {
+        for (auto const& filter : aligned)
+            if (to_type(filter.type) == type)
+                return std::pair{filter.align, filter.phase};
+        return std::pair{std::size_t(1), std::size_t(0)};
+    };
+
+    for (std::size_t origin : {0, 3, 0x1001})
+    {
+        CAPTURE(origin);
+        auto const part = data.subspan(origin);
+        // The matches without alignment at aligned offsets in the file.
+        std::vector<std::tuple<std::streamoff, Type, std::string>> expected;
+        Settings settings;
+        settings.origin = origin;
+        auto const all = inspect(part, unaligned, settings);
+        for (auto const& entry : all)
+        {
+            auto const [align, phase] = stride(entry.type);
+            if (std::size_t(entry.address) % align == phase)
+                expected.emplace_back(entry.address, entry.type, all.value(entry));
+        }
+        REQUIRE(expected.size() > 100);
+        // The order in a row depends on the origin, as in the "origin" test.
+        std::sort(expected.begin(), expected.end());
+        for (auto engine : {Engine::stream, Engine::buffer, Engine::fused})
+            for (unsigned jobs : {1, 3})
+            {
+                CAPTURE(engine);
+                CAPTURE(jobs);
+                settings.engine = engine;
+                settings.jobs = jobs;
+                std::vector<std::tuple<std::streamoff, Type, std::string>> out;
+                auto const report = inspect(part, aligned, settings);
+                for (auto const& entry : report)
+                    out.emplace_back(entry.address, entry.type, report.value(entry));
+                std::sort(out.begin(), out.end());
+                CHECK(out == expected);
+            }
+    }
+
+    // Filters with different alignments aren't run together.
+    Spec const both{{"i32", {"-1000", "1000"}, 4}, {"i32be", {"-1000", "1000"}, 4, 1},
+                    {"f64", {"-1e6", "1e6", "1e-6"}, 2}, {"f64be", {"-1e6", "1e6", "1e-6"}, 2},
+                    {"i16", {"0", "100"}, 8, 3}, {"i16be", {"-100", "100"}}};
+    check_engine(test_bytes(0x10000, 9), both, Engine::buffer);
+    check_jobs(test_bytes(0x30000, 10), both);
 }
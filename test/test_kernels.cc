@@ -0,0 +1,415 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "../src/kernels.hh"
+#include "doctest.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+/// @return The instruction sets that can be tested on this CPU.
+std::vector<Isa> testable_isas()
+{
+    std::vector<Isa> out;
+    for (auto isa : {Isa::scalar, Isa::sse4_2, Isa::avx2, Isa::avx512})
+        if (isa <= supported_isa())
+            out.push_back(isa);
+    return out;
+}
+
+/// @return The bit for offset i in the mask.
+bool bit(std::vector<uint64_t> const& mask, size_t i)
+{
+    return mask[i / 64] >> (i % 64) & 1;
+}
+
+/// Check the integer kernel against a one-at-a-time test for each instruction set, in
+/// both byte orders.
+template <typename T>
+void check_match_range(T low, T high)
+{
+    std::mt19937 gen(sizeof(T));
+    // Small values so that ranges near zero have matches.
+    std::vector<std::byte> data(1000);
+    for (auto& b : data)
+        b = std::byte(gen() % 4 == 0 ? gen() : gen() % 3 == 0 ? 0xff : 0);
+    // Plant numbers at and just past the ends of the range in both byte orders. Their
+    // high bytes pass the kernels' byte filters whether or not they're in the range.
+    using U = std::make_unsigned_t<T>;
+    T const edges[] = {low, T(U(low) - 1), high, T(U(high) + 1), T(low / 2 + high / 2)};
+    for (size_t offset = 0; offset + sizeof(T) <= data.size(); offset += 20 + gen() % 40)
+    {
+        auto value = edges[gen() % std::size(edges)];
+        if (gen() % 2 == 0)
+            value = byte_swap(value);
+        std::memcpy(data.data() + offset, &value, sizeof value);
+    }
+
+    for (auto isa : testable_isas())
+    {
+        CAPTURE(static_cast<int>(isa));
+        use_isa(isa);
+        // Vary the alignment and the number of offsets left over after the vector loop.
+        for (size_t start : {0, 1, 3, 7})
+        {
+            for (size_t count : {0, 1, 15, 16, 17, 63, 64, 65, 200, 900})
+            {
+                auto const p = data.data() + start;
+                std::vector<uint64_t> mask((count + 63) / 64, ~uint64_t(0));
+                auto swapped = mask, both = mask, both_swapped = mask;
+                match_range(p, count, low, high, mask.data());
+                match_range(p, count, low, high, swapped.data(), true);
+                // A different range for the other byte order.
+                match_range_both(p, count, low, high, T(0), high, both.data(),
+                                 both_swapped.data());
+                for (size_t i = 0; i < count; ++i)
+                {
+                    T value;
+                    std::memcpy(&value, p + i, sizeof value);
+                    auto const other = byte_swap(value);
+                    CHECK(bit(mask, i) == (low <= value && value <= high));
+                    CHECK(bit(swapped, i) == (low <= other && other <= high));
+                    CHECK(bit(both, i) == (low <= value && value <= high));
+                    CHECK(bit(both_swapped, i) == (0 <= other && other <= high));
+                }
+            }
+        }
+    }
+    use_isa(supported_isa());
+}
+
+TEST_CASE("integer range kernels")
+{
+    check_match_range<int16_t>(-1000, 1000);
+    check_match_range<int16_t>(1, 0xfe);
+    check_match_range<int16_t>(std::numeric_limits<int16_t>::min(), -1);
+    check_match_range<int32_t>(-1000, 1000);
+    check_match_range<int32_t>(0, 0);
+    check_match_range<int32_t>(std::numeric_limits<int32_t>::min(),
+                               std::numeric_limits<int32_t>::max());
+    check_match_range<int64_t>(-1, 1);
+    check_match_range<int64_t>(0x00ff00ff00ff0001, 0x0100000000000000);
+    check_match_range<int64_t>(std::numeric_limits<int64_t>::min(), 0);
+    // Ranges where a carry changes the fixed high bytes.
+    check_match_range<int16_t>(0x1ff, 0x200);
+    check_match_range<int32_t>(0x1ff00, 0x20100);
+    check_match_range<int32_t>(-0x10000, 0xffff);
+    check_match_range<int64_t>(0x7fffffffffff0000, std::numeric_limits<int64_t>::max());
+    // Ranges too wide to fix any byte. The spans of the low bytes don't fit in 64 bits.
+    check_match_range<int64_t>(-5000000000000000000, 5000000000000000000);
+    check_match_range<int64_t>(std::numeric_limits<int64_t>::min() + 1,
+                               std::numeric_limits<int64_t>::max() - 1);
+    check_match_range<int32_t>(-2000000000, 2000000000);
+    CHECK(byte_swap(int16_t(0x0102)) == 0x0201);
+    CHECK(byte_swap(int32_t(0x01020304)) == 0x04030201);
+    CHECK(byte_swap(int64_t(0x0102030405060708)) == 0x0807060504030201);
+}
+
+/// Check the floating point kernel against a one-at-a-time test for each instruction set,
+/// in both byte orders.
+template <typename T>
+void check_match_float_range(T low, T high, T min)
+{
+    std::mt19937 gen(sizeof(T));
+    std::vector<std::byte> data(1000);
+    for (auto& b : data)
+        b = std::byte(gen());
+    // Plant special values and values at the edges of the range at odd offsets.
+    using limits = std::numeric_limits<T>;
+    T const specials[] = {0, -0.0, 1, -1, 1e-7, -1e-7, 1e-3, 123.4, -1e6, 1e6,
+                          limits::quiet_NaN(), -limits::quiet_NaN(), limits::infinity(),
+                          -limits::infinity(), limits::denorm_min(), limits::min(),
+                          limits::max(), limits::lowest(), low, high,
+                          std::nextafter(low, -limits::infinity()),
+                          std::nextafter(high, limits::infinity()), min, -min,
+                          std::nextafter(min, T(0)), -std::nextafter(min, T(0))};
+    for (size_t offset = 0; offset + sizeof(T) <= data.size(); offset += 1 + gen() % 13)
+    {
+        auto value = specials[gen() % std::size(specials)];
+        if (gen() % 2 == 0)
+            value = byte_swap(value);
+        std::memcpy(data.data() + offset, &value, sizeof value);
+    }
+    auto const in_range = [&](T value) {
+        return low <= value && value <= high && (std::abs(value) >= min || value == 0);
+    };
+
+    for (auto isa : testable_isas())
+    {
+        CAPTURE(static_cast<int>(isa));
+        use_isa(isa);
+        for (size_t start : {0, 1, 5})
+        {
+            for (size_t count : {0, 1, 16, 31, 64, 130, 900})
+            {
+                auto const p = data.data() + start;
+                std::vector<uint64_t> mask((count + 63) / 64, ~uint64_t(0));
+                auto swapped = mask, both = mask, both_swapped = mask;
+                match_range(p, count, low, high, min, mask.data());
+                match_range(p, count, low, high, min, swapped.data(), true);
+                match_range_both(p, count, low, high, min, low, high, min, both.data(),
+                                 both_swapped.data());
+                for (size_t i = 0; i < count; ++i)
+                {
+                    T value;
+                    std::memcpy(&value, p + i, sizeof value);
+                    CHECK(bit(mask, i) == in_range(value));
+                    CHECK(bit(swapped, i) == in_range(byte_swap(value)));
+                    CHECK(bit(both, i) == in_range(value));
+                    CHECK(bit(both_swapped, i) == in_range(byte_swap(value)));
+                }
+            }
+        }
+    }
+    use_isa(supported_isa());
+}
+
+TEST_CASE("floating point range kernels")
+{
+    check_match_float_range<float>(-1e6, 1e6, 1e-6);
+    check_match_float_range<float>(-1e-6, 1e6, 1e-6);
+    check_match_float_range<float>(1, 100, 0);
+    check_match_float_range<float>(-std::numeric_limits<float>::infinity(),
+                                   std::numeric_limits<float>::infinity(), 0);
+    check_match_float_range<double>(-1e6, 1e6, 1e-6);
+    check_match_float_range<double>(-100, 100, 100);
+    check_match_float_range<double>(0, 0, 0);
+    check_match_float_range<double>(-1e300, 1e300, 1e-300);
+    // Narrow ranges that skip vectors by the exponent.
+    check_match_float_range<float>(1, 1.9f, 0);
+    check_match_float_range<float>(-1e-30f, 1e-30f, 1e-35f);
+    check_match_float_range<double>(-1e4, -1e3, 0);
+    check_match_float_range<double>(1e3, 1e6, 0);
+    check_match_float_range<double>(-2, 3, 1);
+    check_match_float_range<double>(-1.5, 1.5, 1);
+}
+
+/// Check that the kernels with a stride set the same bits as without one at the offsets in
+/// the stride and no others, for each instruction set, in both byte orders.
+template <typename T>
+void check_stride()
+{
+    std::mt19937 gen(sizeof(T) + 1);
+    std::vector<std::byte> data(1200);
+    for (auto& b : data)
+        b = std::byte(gen() % 4 == 0 ? gen() : gen() % 3 == 0 ? 0xff : 0);
+    // Wide ranges so that about half the offsets match.
+    T const low = std::is_integral_v<T> ? T(0) : T(-1e30);
+    T const high = std::is_integral_v<T> ? std::numeric_limits<T>::max() : T(1e30);
+
+    auto const run = [&](std::byte const* p, size_t count, uint64_t* mask,
+                         uint64_t* swapped, Stride const& stride) {
+        if constexpr (std::is_integral_v<T>)
+            match_range_both(p, count, low, high, low, high, mask, swapped, stride);
+        else
+            match_range_both(p, count, low, high, T(0), low, high, T(0), mask, swapped,
+                             stride);
+    };
+    for (auto isa : testable_isas())
+    {
+        CAPTURE(static_cast<int>(isa));
+        use_isa(isa);
+        for (size_t start : {0, 3})
+        {
+            for (size_t count : {0, 5, 64, 100, 1100})
+            {
+                auto const p = data.data() + start;
+                std::vector<uint64_t> all((count + 63) / 64, ~uint64_t(0));
+                auto all_swapped = all;
+                run(p, count, all.data(), all_swapped.data(), {});
+                for (size_t align : {1, 2, 4, 8, 16, 64, 128})
+                {
+                    for (size_t phase : {size_t(0), size_t(1), align / 2 + 1, align - 1})
+                    {
+                        phase %= align;
+                        CAPTURE(align);
+                        CAPTURE(phase);
+                        std::vector<uint64_t> mask(all.size(), ~uint64_t(0));
+                        auto swapped = mask, single = mask;
+                        run(p, count, mask.data(), swapped.data(), {align, phase});
+                        if constexpr (std::is_integral_v<T>)
+                            match_range(p, count, low, high, single.data(), true,
+                                        {align, phase});
+                        else
+                            match_range(p, count, low, high, T(0), single.data(), true,
+                                        {align, phase});
+                        for (size_t i = 0; i < count; ++i)
+                        {
+                            auto const in_stride = i % align == phase;
+                            CHECK(bit(mask, i) == (in_stride && bit(all, i)));
+                            CHECK(bit(swapped, i) == (in_stride && bit(all_swapped, i)));
+                            CHECK(bit(single, i) == bit(swapped, i));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    use_isa(supported_isa());
+}
+
+TEST_CASE("strided range kernels")
+{
+    check_stride<int16_t>();
+    check_stride<int32_t>();
+    check_stride<int64_t>();
+    check_stride<float>();
+    check_stride<double>();
+}
+
+/// Check the classification kernel against the charset's tables for each instruction set.
+void check_classify(Charset const& charset)
+{
+    std::mt19937 gen(3);
+    std::vector<std::byte> data(1000);
+    for (auto& b : data)
+        b = std::byte(gen() % 3 == 0 ? gen() % 16 : gen());
+
+    for (auto isa : testable_isas())
+    {
+        CAPTURE(static_cast<int>(isa));
+        use_isa(isa);
+        for (size_t start : {0, 1, 9})
+        {
+            for (size_t count : {0, 1, 63, 64, 65, 128, 900})
+            {
+                auto const words = (count + 63) / 64;
+                std::vector<std::vector<uint64_t>> printable(
+                    charset.size(), std::vector<uint64_t>(words, ~uint64_t(0)));
+                std::vector<uint64_t*> sets;
+                for (auto& set : printable)
+                    sets.push_back(set.data());
+                std::vector<uint64_t> terminator(words, ~uint64_t(0));
+                std::vector<uint64_t> zero(words, ~uint64_t(0));
+                classify(data.data() + start, count, charset,
+                         sets.data(), terminator.data(), zero.data());
+                for (size_t i = 0; i < count; ++i)
+                {
+                    auto c = std::to_integer<unsigned char>(data[start + i]);
+                    for (size_t set = 0; set < charset.size(); ++set)
+                        CHECK((printable[set][i / 64] >> (i % 64) & 1)
+                              == charset.printable(c, set));
+                    CHECK((terminator[i / 64] >> (i % 64) & 1) == is_terminator(c));
+                    CHECK((zero[i / 64] >> (i % 64) & 1) == (c == 0));
+                }
+            }
+        }
+    }
+    use_isa(supported_isa());
+}
+
+TEST_CASE("charset")
+{
+    Charset latin_1(Latin_1::printable);
+    CHECK(latin_1.has_nibble_tables());
+    CHECK(latin_1.printable(' '));
+    CHECK(latin_1.printable(0xe6));
+    CHECK(!latin_1.printable(0x7f));
+    CHECK(!latin_1.printable(0x85));
+
+    Charset ascii(Ascii::printable);
+    CHECK(ascii.has_nibble_tables());
+    CHECK(!ascii.printable(0x1f));
+    CHECK(ascii.printable(' '));
+    CHECK(ascii.printable('~'));
+    CHECK(!ascii.printable(0xe6));
+
+    // Too many distinct rows for the nibble tables.
+    std::array<bool, 256> diagonal{};
+    for (int c = 0; c < 256; c += 17)
+        diagonal[c] = true;
+    Charset odd(diagonal);
+    CHECK(!odd.has_nibble_tables());
+    CHECK(odd.printable(0x11));
+    CHECK(!odd.printable(0x12));
+
+    // Sets share the nibble tables but not their class bits.
+    Charset both({Latin_1::printable, Ascii::printable});
+    CHECK(both.has_nibble_tables());
+    CHECK(both.size() == 2);
+    CHECK((both.bits(0) & both.bits(1)) == 0);
+    CHECK(both.printable(0xe6, 0));
+    CHECK(!both.printable(0xe6, 1));
+    CHECK(both.printable('~', 1));
+
+    // Each of these needs 4 bits, so there aren't enough for both.
+    std::array<bool, 256> rows{};
+    for (int h = 0; h < 4; ++h)
+        rows[16*h + h] = true;
+    CHECK(Charset(rows).has_nibble_tables());
+    CHECK(!Charset({rows, rows}).has_nibble_tables());
+}
+
+TEST_CASE("classify kernels")
+{
+    check_classify(Charset(Latin_1::printable));
+    check_classify(Charset(Ascii::printable));
+    std::array<bool, 256> diagonal{};
+    for (int c = 0; c < 256; c += 17)
+        diagonal[c] = true;
+    check_classify(Charset(diagonal));
+    check_classify(Charset({Latin_1::printable, Ascii::printable}));
+    check_classify(Charset({Ascii::printable, diagonal}));
+}
+
+TEST_CASE("mask offset kernels")
+{
+    std::mt19937_64 gen(5);
+    for (auto isa : testable_isas())
+    {
+        CAPTURE(static_cast<int>(isa));
+        use_isa(isa);
+        // Empty, sparse, dense, and full masks, and masks with some empty words.
+        for (int density : {0, 1, 2, 3, 4})
+        {
+            for (size_t count : {0, 1, 15, 16, 17, 63, 64, 65, 1000})
+            {
+                CAPTURE(density);
+                CAPTURE(count);
+                std::vector<uint64_t> mask((count + 63) / 64);
+                for (auto& word : mask)
+                    word = density == 0 ? 0
+                        : density == 1 ? gen() & gen() & gen()
+                        : density == 2 ? (gen() % 2 == 0 ? 0 : gen())
+                        : density == 3 ? gen() | gen() : ~uint64_t(0);
+                if (count % 64 != 0)
+                    mask.back() &= (uint64_t(1) << count % 64) - 1;
+                std::vector<uint32_t> expected;
+                for (size_t i = 0; i < count; ++i)
+                    if (bit(mask, i))
+                        expected.push_back(i);
+                std::vector<uint32_t> offsets(expected.size() + 1, 0xdeadbeef);
+                auto const n = mask_offsets(mask.data(), count, offsets.data());
+                REQUIRE(n == expected.size());
+                CHECK(std::equal(expected.begin(), expected.end(), offsets.begin()));
+                // Nothing is written past the last offset.
+                CHECK(offsets.back() == 0xdeadbeef);
+            }
+        }
+    }
+    use_isa(supported_isa());
+}
+
+TEST_CASE("instruction set selection")
+{
+    CHECK(use_isa(Isa::scalar) == Isa::scalar);
+    CHECK(use_isa(Isa::avx512) == supported_isa());
+}
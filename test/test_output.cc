@@ -0,0 +1,71 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "../src/output.hh"
+#include "doctest.h"
+
+#include <cstdio>
+#include <string>
+
+#include <unistd.h>
+
+/// @return The contents of a temporary file.
+std::string contents(std::FILE* file)
+{
+    std::string out;
+    std::rewind(file);
+    for (int c; (c = std::fgetc(file)) != EOF;)
+        out += static_cast<char>(c);
+    return out;
+}
+
+TEST_CASE("fd writer")
+{
+    auto file = std::tmpfile();
+    REQUIRE(file);
+    std::string expected;
+    {
+        Fd_Writer out(fileno(file), 16);
+        out.write("0123456789");
+        expected += "0123456789";
+        // Nothing is written until the buffer fills.
+        CHECK(contents(file).empty());
+        out.write("abcdefghij");
+        expected += "abcdefghij";
+        CHECK(contents(file) == "0123456789");
+        // Text longer than the buffer is written directly.
+        std::string const long_text(40, 'x');
+        out.write(long_text);
+        expected += long_text;
+        CHECK(contents(file) == expected);
+        out.write("end");
+        expected += "end";
+    }
+    // The rest is written on destruction.
+    CHECK(contents(file) == expected);
+    std::fclose(file);
+}
+
+TEST_CASE("fd writer error")
+{
+    int fds[2];
+    REQUIRE(::pipe(fds) == 0);
+    ::close(fds[1]);
+    // Writing to a read-only descriptor fails.
+    Fd_Writer out(fds[0]);
+    out.write("text");
+    CHECK_THROWS_AS(out.flush(), bad_write);
+    ::close(fds[0]);
+}
@@ -0,0 +1,67 @@
+// Copyright © 2020-2021 Sam Varner
+//
+// This file is part of Inspect.
+//
+// Composure is free software: you can redistribute it and/or modify it under the terms of
+// the GNU General Public License as published by the Free Software Foundation, either
+// version 3 of the License, or (at your option) any later version.
+//
+// Composure is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY;
+// without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+// PURPOSE.  See the GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License along with Composure.
+// If not, see <http://www.gnu.org/licenses/>.
+
+#include "../src/thread_pool.hh"
+#include "doctest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+TEST_CASE("available cpus")
+{
+    CHECK(available_cpus() >= 1);
+    CHECK(available_cpus() <= std::thread::hardware_concurrency());
+}
+
+TEST_CASE("thread pool")
+{
+    for (unsigned threads : {0, 1, 2, 7})
+    {
+        CAPTURE(threads);
+        Thread_Pool pool(threads);
+        CHECK(pool.threads() == std::max(threads, 1u));
+        // The pool runs one batch after another.
+        for (size_t count : {0, 1, 5, 100})
+        {
+            std::vector<std::atomic<int>> runs(count);
+            std::vector<std::function<void()>> tasks;
+            for (size_t i = 0; i < count; ++i)
+                tasks.push_back([&runs, i] { ++runs[i]; });
+            pool.run(std::move(tasks));
+            for (auto const& n : runs)
+                CHECK(n == 1);
+        }
+    }
+}
+
+TEST_CASE("thread pool exception")
+{
+    Thread_Pool pool(3);
+    std::atomic<int> runs = 0;
+    std::vector<std::function<void()>> tasks;
+    for (size_t i = 0; i < 10; ++i)
+        tasks.push_back([&runs, i] {
+            ++runs;
+            if (i == 4)
+                throw std::runtime_error("task");
+        });
+    CHECK_THROWS_AS(pool.run(std::move(tasks)), std::runtime_error);
+    // The other tasks still ran, and the pool can be used again.
+    CHECK(runs == 10);
+    pool.run({[&runs] { ++runs; }});
+    CHECK(runs == 11);
+}
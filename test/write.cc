@@ -40,23 +40,56 @@ template <> void write(std::ostream& os, char16_t const* str)
     while (*str++);
 }
 
+/// Write about 'size' bytes that make string searches do the most work with the default
+/// s8 limits of 3 to 64: runs of printable characters in both byte parities just shorter
+/// and just longer than the limits, and runs longer than the chunks that are scanned in
+/// parallel.
+void write_hard_strings(std::ostream& os, std::size_t size)
+{
+    std::size_t const lengths[] = {1, 2, 3, 63, 64, 65, 66, 1 << 20};
+    std::size_t written = 0;
+    for (std::size_t i = 0; written < size; ++i)
+    {
+        auto const length = lengths[i % std::size(lengths)];
+        auto const wide = i / std::size(lengths) % 2 == 1;
+        for (std::size_t j = 0; j < length; ++j)
+        {
+            os.put('x');
+            if (wide)
+                os.put('\0');
+        }
+        os.put(i % 3 == 0 ? '\t' : '\0');
+        written += (wide ? 2 : 1)*length + 1;
+    }
+}
+
 int main(int argc, char** argv)
 {
     bool wide = false;
+    std::size_t hard_size = 0;
     char c;
-    while ((c = getopt(argc, argv, "u")) != -1)
+    while ((c = getopt(argc, argv, "us:")) != -1)
     {
         if (c == 'u')
             wide = true;
+        else if (c == 's')
+            hard_size = std::stoul(optarg) << 20;
     }
     if (argc - optind != 1)
     {
-        std::cerr << "Usage: write [-u] FILE\n";
+        std::cerr << "Usage: write [-u] [-s N] FILE\n"
+                  << "  -u    write wide strings\n"
+                  << "  -s N  write N MiB of data that's hard for string searches instead\n";
         exit(-1);
     }
     std::string file = argv[optind];
 
     std::ofstream os(file);
+    if (hard_size > 0)
+    {
+        write_hard_strings(os, hard_size);
+        return !os.good();
+    }
     write(os, 1.23); // 3ff3 ae14 7ae1 47ae -> ae47 e17a 14ae f33f
     write(os, 432); // 1b0 -> b001 0000
     write(os, 0x00ffeeffeeffeeffL); // ffee... = 72038902055038719